@@ -0,0 +1,121 @@
+/*
+ This file is part of vedgTools/CommonUtilities.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/CommonUtilities is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/CommonUtilities is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/CommonUtilities.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# ifndef COMMON_UTILITIES_ARENA_HPP
+# define COMMON_UTILITIES_ARENA_HPP
+
+# include "StringView.hpp"
+# include "CopyAndMoveSemantics.hpp"
+
+# include <cstddef>
+# include <cstring>
+# include <utility>
+# include <memory>
+# include <vector>
+
+
+namespace CommonUtilities
+{
+/// @brief Monotonic storage of texts. Texts are copied into a few large
+/// blocks and are freed all at once by clear() or by the destructor.
+/// Stored texts never move, so StringViews of them remain valid until then.
+/// WARNING: is not thread-safe.
+class TextArena
+{
+public:
+    explicit TextArena(std::size_t blockSize = 1 << 16)
+        : blockSize_(blockSize) {}
+
+    TextArena(const TextArena &) = delete;
+    TextArena & operator=(const TextArena &) = delete;
+
+    /// @brief Takes over other's texts. other becomes empty.
+    TextArena(TextArena && other) noexcept
+        : blockSize_(other.blockSize_), blocks_(std::move(other.blocks_)),
+          next_(other.next_), available_(other.available_),
+          capacity_(other.capacity_) {
+        other.clear();
+    }
+
+    /// @brief Frees this arena's texts and takes over other's texts.
+    /// other becomes empty.
+    TextArena & operator=(TextArena && other)
+        ASSIGNMENT_OPERATOR_REF_QUALIFICATION noexcept {
+        if (this != &other) {
+            blockSize_ = other.blockSize_;
+            blocks_ = std::move(other.blocks_);
+            next_ = other.next_;
+            available_ = other.available_;
+            capacity_ = other.capacity_;
+            other.clear();
+        }
+        return *this;
+    }
+
+    /// @return Uninitialized storage of size chars.
+    char * allocate(std::size_t size) {
+        if (size > available_) {
+            // Big texts get blocks of their own, so that the rest of the
+            // current block is not wasted.
+            if (size > blockSize_ / 4)
+                return addBlock(size);
+            next_ = addBlock(blockSize_);
+            available_ = blockSize_;
+        }
+        char * const result = next_;
+        next_ += size;
+        available_ -= size;
+        return result;
+    }
+
+    /// @return View of the stored copy of text.
+    StringView copy(StringView text) {
+        if (text.empty())
+            return StringView();
+        char * const data = allocate(text.size());
+        std::memcpy(data, text.data(), text.size());
+        return { data, text.size() };
+    }
+
+    /// @return Total size of the allocated blocks.
+    std::size_t capacity() const { return capacity_; }
+
+    /// @brief Frees all texts.
+    void clear() {
+        blocks_.clear();
+        next_ = nullptr;
+        available_ = capacity_ = 0;
+    }
+
+private:
+    char * addBlock(std::size_t size) {
+        blocks_.emplace_back(new char[size]);
+        capacity_ += size;
+        return blocks_.back().get();
+    }
+
+    std::size_t blockSize_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char * next_ = nullptr;
+    std::size_t available_ = 0;
+    std::size_t capacity_ = 0;
+};
+
+} // END namespace CommonUtilities
+
+# endif // COMMON_UTILITIES_ARENA_HPP
@@ -0,0 +1,212 @@
+/*
+ This file is part of vedgTools/CommonUtilities.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/CommonUtilities is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/CommonUtilities is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/CommonUtilities.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# ifndef COMMON_UTILITIES_CASE_FOLD_HPP
+# define COMMON_UTILITIES_CASE_FOLD_HPP
+
+/// CaseFold utilities compare and search text case-insensitively. Only ASCII
+/// letters are folded, which is what std::tolower() does in the "C" locale.
+/// Vector instructions are used under the same conditions as in CharScan.
+
+# include "StringView.hpp"
+# include "CharScan.hpp"
+
+# include <cstddef>
+
+
+namespace CommonUtilities
+{
+namespace CaseFold
+{
+/// @return std::tolower(c) in the "C" locale, regardless of current locale.
+constexpr char toLower(char c)
+{
+    return static_cast<unsigned char>(c - 'A') <= 'Z' - 'A' ?
+           static_cast<char>(c + ('a' - 'A')) : c;
+}
+
+
+namespace Private
+{
+constexpr bool isLowerLetter(char c)
+{
+    return static_cast<unsigned char>(c - 'a') <= 'z' - 'a';
+}
+
+inline bool equalsScalar(const char * lower, const char * mixed,
+                         std::size_t size)
+{
+    for (std::size_t i = 0; i < size; ++i) {
+        if (toLower(mixed[i]) != lower[i])
+            return false;
+    }
+    return true;
+}
+
+inline const char * findScalar(const char * first, const char * last,
+                               StringView lower)
+{
+    const char * const lastStart = last - lower.size();
+    for (; first <= lastStart; ++first) {
+        if (toLower(*first) == lower[0] &&
+                equalsScalar(lower.data() + 1, first + 1, lower.size() - 1)) {
+            return first;
+        }
+    }
+    return last;
+}
+
+# if COMMON_UTILITIES_CHAR_SCAN_SSE2
+/// @return v with ASCII uppercase letters converted to lowercase.
+inline __m128i foldCase(__m128i v)
+{
+    // Chars >= 0x80 are negative, so signed comparisons exclude them.
+    const __m128i upper = _mm_and_si128(
+                              _mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                              _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+/// @return Bit that must be set in mixed chars before comparing them with
+/// lower: only the two cases of a letter differ in it.
+constexpr char foldBit(char lower)
+{
+    return isLowerLetter(lower) ? 0x20 : 0;
+}
+
+inline bool equalsSse2(const char * lower, const char * mixed,
+                       std::size_t size)
+{
+    for (; size >= 16; size -= 16, lower += 16, mixed += 16) {
+        const __m128i folded = foldCase(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(mixed)));
+        const __m128i expected =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(lower));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(folded, expected)) != 0xFFFF)
+            return false;
+    }
+    return equalsScalar(lower, mixed, size);
+}
+
+/// @brief Compares 16 candidate positions at once by their first and last
+/// chars and checks the whole string only where both match.
+inline const char * findSse2(const char * first, const char * last,
+                             StringView lower)
+{
+    const std::size_t lastOffset = lower.size() - 1;
+    const __m128i firstFold = _mm_set1_epi8(foldBit(lower[0]));
+    const __m128i firstChar = _mm_set1_epi8(lower[0]);
+    const __m128i lastFold = _mm_set1_epi8(foldBit(lower[lastOffset]));
+    const __m128i lastChar = _mm_set1_epi8(lower[lastOffset]);
+    // Loads must not read past last.
+    for (; last - first >= static_cast<std::ptrdiff_t>(lastOffset + 16);
+            first += 16) {
+        const __m128i head =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+        const __m128i tail = _mm_loadu_si128(
+                                 reinterpret_cast<const __m128i *>(
+                                     first + lastOffset));
+        unsigned bits = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_and_si128(
+                _mm_cmpeq_epi8(_mm_or_si128(head, firstFold), firstChar),
+                _mm_cmpeq_epi8(_mm_or_si128(tail, lastFold), lastChar))));
+        for (; bits != 0; bits &= bits - 1) {
+            const char * const candidate =
+                first + CharScan::Private::countTrailingZeros(bits);
+            if (equalsSse2(lower.data(), candidate, lower.size()))
+                return candidate;
+        }
+    }
+    return findScalar(first, last, lower);
+}
+# endif // COMMON_UTILITIES_CHAR_SCAN_SSE2
+
+# if COMMON_UTILITIES_CHAR_SCAN_AVX2
+__attribute__((target("avx2")))
+inline const char * findAvx2(const char * first, const char * last,
+                             StringView lower)
+{
+    const std::size_t lastOffset = lower.size() - 1;
+    const __m256i firstFold = _mm256_set1_epi8(foldBit(lower[0]));
+    const __m256i firstChar = _mm256_set1_epi8(lower[0]);
+    const __m256i lastFold = _mm256_set1_epi8(foldBit(lower[lastOffset]));
+    const __m256i lastChar = _mm256_set1_epi8(lower[lastOffset]);
+    for (; last - first >= static_cast<std::ptrdiff_t>(lastOffset + 32);
+            first += 32) {
+        const __m256i head =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+        const __m256i tail = _mm256_loadu_si256(
+                                 reinterpret_cast<const __m256i *>(
+                                     first + lastOffset));
+        unsigned bits = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(_mm256_or_si256(head, firstFold),
+                                  firstChar),
+                _mm256_cmpeq_epi8(_mm256_or_si256(tail, lastFold),
+                                  lastChar))));
+        for (; bits != 0; bits &= bits - 1) {
+            const char * const candidate =
+                first + CharScan::Private::countTrailingZeros(bits);
+            if (equalsSse2(lower.data(), candidate, lower.size()))
+                return candidate;
+        }
+    }
+    return findSse2(first, last, lower);
+}
+# endif // COMMON_UTILITIES_CHAR_SCAN_AVX2
+
+} // END namespace Private
+
+
+/// @return true if toLower(mixed[i]) == lower[i] for each i in [0, size).
+/// WARNING: lower must be in lowercase, otherwise it never matches.
+inline bool equals(const char * lower, const char * mixed, std::size_t size)
+{
+# if COMMON_UTILITIES_CHAR_SCAN_SSE2
+    return Private::equalsSse2(lower, mixed, size);
+# else
+    return Private::equalsScalar(lower, mixed, size);
+# endif
+}
+
+/// @return Pointer to the first occurrence of lower in [first, last)
+/// ignoring case of the searched text; last if there is no such occurrence.
+/// first if lower is empty.
+/// WARNING: lower must be in lowercase, otherwise it never matches.
+inline const char * find(const char * first, const char * last,
+                         StringView lower)
+{
+    if (lower.empty())
+        return first;
+    if (last - first < static_cast<std::ptrdiff_t>(lower.size()))
+        return last;
+# if COMMON_UTILITIES_CHAR_SCAN_AVX2
+    if (last - first >= 64 && CharScan::Private::hasAvx2())
+        return Private::findAvx2(first, last, lower);
+# endif
+# if COMMON_UTILITIES_CHAR_SCAN_SSE2
+    return Private::findSse2(first, last, lower);
+# else
+    return Private::findScalar(first, last, lower);
+# endif
+}
+
+} // END namespace CaseFold
+} // END namespace CommonUtilities
+
+# endif // COMMON_UTILITIES_CASE_FOLD_HPP
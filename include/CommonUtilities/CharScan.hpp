@@ -0,0 +1,294 @@
+/*
+ This file is part of vedgTools/CommonUtilities.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/CommonUtilities is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/CommonUtilities is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/CommonUtilities.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# ifndef COMMON_UTILITIES_CHAR_SCAN_HPP
+# define COMMON_UTILITIES_CHAR_SCAN_HPP
+
+/// CharScan utilities search for the first/last character that belongs (or
+/// does not belong) to a fixed character class. On x86 with GCC or Clang,
+/// SSE2 is used, and AVX2 is used if the processor supports it (checked at
+/// runtime). Otherwise characters are examined one at a time.
+
+# if defined(__GNUC__) && defined(__SSE2__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#   define COMMON_UTILITIES_CHAR_SCAN_SSE2 1
+#   if defined(__clang__) || __GNUC__ >= 5
+#     define COMMON_UTILITIES_CHAR_SCAN_AVX2 1
+#   else
+#     define COMMON_UTILITIES_CHAR_SCAN_AVX2 0
+#   endif
+# else
+#   define COMMON_UTILITIES_CHAR_SCAN_SSE2 0
+#   define COMMON_UTILITIES_CHAR_SCAN_AVX2 0
+# endif
+
+# if COMMON_UTILITIES_CHAR_SCAN_SSE2
+#   include <emmintrin.h>
+# endif
+# if COMMON_UTILITIES_CHAR_SCAN_AVX2
+#   include <immintrin.h>
+# endif
+
+
+namespace CommonUtilities
+{
+namespace CharScan
+{
+/// Character classes. Membership of each of the 256 char values is the same
+/// as the result of corresponding <cctype> function in the "C" locale,
+/// regardless of current locale.
+enum Class
+{
+    space,              ///< std::isspace(c)
+    blank,              ///< std::isblank(c)
+    spaceExceptEol,     ///< std::isspace(c) && c != '\n'
+    spaceOrClosingParen ///< std::isspace(c) || c == ')'
+};
+
+template <Class cls>
+constexpr bool contains(char c)
+{
+    return cls == blank ? c == ' ' || c == '\t' :
+           (c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t')
+           ? cls != spaceExceptEol || c != '\n' :
+           cls == spaceOrClosingParen && c == ')';
+}
+
+
+namespace Private
+{
+template <Class cls, bool member>
+const char * findForwardScalar(const char * first, const char * last)
+{
+    while (first != last && contains<cls>(*first) != member)
+        ++first;
+    return first;
+}
+
+template <Class cls, bool member>
+const char * findBackwardScalar(const char * first, const char * last)
+{
+    while (last != first && contains<cls>(last[-1]) != member)
+        --last;
+    return last;
+}
+
+# if COMMON_UTILITIES_CHAR_SCAN_SSE2
+inline unsigned countTrailingZeros(unsigned bits) {
+    return static_cast<unsigned>(__builtin_ctz(bits));
+}
+inline unsigned highestBit(unsigned bits) {
+    return 31 - static_cast<unsigned>(__builtin_clz(bits));
+}
+
+/// @return Bit i is set if v[i] belongs to cls.
+template <Class cls>
+inline unsigned mask(__m128i v)
+{
+    __m128i result;
+    if (cls == blank) {
+        result = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                              _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    }
+    else {
+        // '\t' <= c && c <= '\r' <=> unsigned(c - '\t') <= '\r' - '\t'.
+        const __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+        const __m128i control = _mm_cmpeq_epi8(
+            _mm_subs_epu8(shifted, _mm_set1_epi8('\r' - '\t')),
+            _mm_setzero_si128());
+        result = _mm_or_si128(control, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+        if (cls == spaceExceptEol) {
+            result = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                      result);
+        }
+        else if (cls == spaceOrClosingParen) {
+            result = _mm_or_si128(result,
+                                  _mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+        }
+    }
+    return static_cast<unsigned>(_mm_movemask_epi8(result));
+}
+
+template <Class cls, bool member>
+const char * findForwardSse2(const char * first, const char * last)
+{
+    for (; last - first >= 16; first += 16) {
+        unsigned bits = mask<cls>(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(first)));
+        if (! member)
+            bits = ~bits & 0xFFFFu;
+        if (bits != 0)
+            return first + countTrailingZeros(bits);
+    }
+    return findForwardScalar<cls, member>(first, last);
+}
+
+template <Class cls, bool member>
+const char * findBackwardSse2(const char * first, const char * last)
+{
+    for (; last - first >= 16; last -= 16) {
+        unsigned bits = mask<cls>(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(last - 16)));
+        if (! member)
+            bits = ~bits & 0xFFFFu;
+        if (bits != 0)
+            return last - 16 + highestBit(bits) + 1;
+    }
+    return findBackwardScalar<cls, member>(first, last);
+}
+# endif // COMMON_UTILITIES_CHAR_SCAN_SSE2
+
+# if COMMON_UTILITIES_CHAR_SCAN_AVX2
+inline bool hasAvx2()
+{
+    static const bool result = (__builtin_cpu_init(),
+                                __builtin_cpu_supports("avx2") != 0);
+    return result;
+}
+
+/// @return Bit i is set if v[i] belongs to cls.
+template <Class cls>
+__attribute__((target("avx2")))
+inline unsigned mask(__m256i v)
+{
+    __m256i result;
+    if (cls == blank) {
+        result = _mm256_or_si256(
+                     _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                     _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    }
+    else {
+        const __m256i shifted = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+        const __m256i control = _mm256_cmpeq_epi8(
+            _mm256_subs_epu8(shifted, _mm256_set1_epi8('\r' - '\t')),
+            _mm256_setzero_si256());
+        result = _mm256_or_si256(
+                     control, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+        if (cls == spaceExceptEol) {
+            result = _mm256_andnot_si256(
+                         _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), result);
+        }
+        else if (cls == spaceOrClosingParen) {
+            result = _mm256_or_si256(
+                         result, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(')')));
+        }
+    }
+    return static_cast<unsigned>(_mm256_movemask_epi8(result));
+}
+
+template <Class cls, bool member>
+__attribute__((target("avx2")))
+const char * findForwardAvx2(const char * first, const char * last)
+{
+    for (; last - first >= 32; first += 32) {
+        unsigned bits = mask<cls>(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first)));
+        if (! member)
+            bits = ~bits;
+        if (bits != 0)
+            return first + countTrailingZeros(bits);
+    }
+    return findForwardSse2<cls, member>(first, last);
+}
+
+template <Class cls, bool member>
+__attribute__((target("avx2")))
+const char * findBackwardAvx2(const char * first, const char * last)
+{
+    for (; last - first >= 32; last -= 32) {
+        unsigned bits = mask<cls>(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(last - 32)));
+        if (! member)
+            bits = ~bits;
+        if (bits != 0)
+            return last - 32 + highestBit(bits) + 1;
+    }
+    return findBackwardSse2<cls, member>(first, last);
+}
+# endif // COMMON_UTILITIES_CHAR_SCAN_AVX2
+
+/// @return Pointer to the first character in [first, last) whose membership
+/// in cls equals member; last if there is no such character.
+template <Class cls, bool member>
+inline const char * findForward(const char * first, const char * last)
+{
+    // Most scans stop at the very first character. Don't pay for vector setup.
+    if (first == last || contains<cls>(*first) == member)
+        return first;
+    ++first;
+# if COMMON_UTILITIES_CHAR_SCAN_AVX2
+    if (last - first >= 32 && hasAvx2())
+        return findForwardAvx2<cls, member>(first, last);
+# endif
+# if COMMON_UTILITIES_CHAR_SCAN_SSE2
+    return findForwardSse2<cls, member>(first, last);
+# else
+    return findForwardScalar<cls, member>(first, last);
+# endif
+}
+
+/// @return Pointer past the last character in [first, last) whose membership
+/// in cls equals member; first if there is no such character.
+template <Class cls, bool member>
+inline const char * findBackward(const char * first, const char * last)
+{
+    if (first == last || contains<cls>(last[-1]) == member)
+        return last;
+    --last;
+# if COMMON_UTILITIES_CHAR_SCAN_AVX2
+    if (last - first >= 32 && hasAvx2())
+        return findBackwardAvx2<cls, member>(first, last);
+# endif
+# if COMMON_UTILITIES_CHAR_SCAN_SSE2
+    return findBackwardSse2<cls, member>(first, last);
+# else
+    return findBackwardScalar<cls, member>(first, last);
+# endif
+}
+
+} // END namespace Private
+
+
+/// @return Pointer to the first character in [first, last) that belongs to
+/// cls; last if there is no such character.
+template <Class cls>
+inline const char * find(const char * first, const char * last)
+{
+    return Private::findForward<cls, true>(first, last);
+}
+
+/// @return Pointer to the first character in [first, last) that does not
+/// belong to cls; last if there is no such character.
+template <Class cls>
+inline const char * skip(const char * first, const char * last)
+{
+    return Private::findForward<cls, false>(first, last);
+}
+
+/// @return Pointer past the last character in [first, last) that does not
+/// belong to cls; first if there is no such character.
+template <Class cls>
+inline const char * skipBackward(const char * first, const char * last)
+{
+    return Private::findBackward<cls, false>(first, last);
+}
+
+} // END namespace CharScan
+} // END namespace CommonUtilities
+
+# endif // COMMON_UTILITIES_CHAR_SCAN_HPP
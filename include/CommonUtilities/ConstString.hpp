@@ -0,0 +1,123 @@
+/*
+ This file is part of vedgTools/CommonUtilities.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/CommonUtilities is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/CommonUtilities is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/CommonUtilities.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# ifndef COMMON_UTILITIES_CONST_STRING_HPP
+# define COMMON_UTILITIES_CONST_STRING_HPP
+
+# include "StringView.hpp"
+
+# include <cstddef>
+# include <string>
+
+
+namespace CommonUtilities
+{
+namespace Private
+{
+template <std::size_t... indices>
+struct IndexList {};
+
+template <std::size_t size, std::size_t... indices>
+struct MakeIndexList : MakeIndexList<size - 1, size - 1, indices...> {};
+
+template <std::size_t... indices>
+struct MakeIndexList<0, indices...>
+{
+    typedef IndexList<indices...> type;
+};
+
+} // END namespace Private
+
+
+/// @brief Null-terminated string of N characters that can be created and
+/// concatenated in constant expressions.
+/// Converts to StringView implicitly; str() returns an std::string copy.
+template <std::size_t N>
+class ConstString
+{
+public:
+    constexpr ConstString(const char (& literal)[N + 1])
+        : ConstString(literal, typename Private::MakeIndexList<N>::type()) {}
+
+    constexpr const char * data() const noexcept { return data_; }
+    constexpr const char * c_str() const noexcept { return data_; }
+    constexpr std::size_t size() const noexcept { return N; }
+    constexpr bool empty() const noexcept { return N == 0; }
+
+    constexpr char operator[](std::size_t pos) const { return data_[pos]; }
+    constexpr char front() const { return data_[0]; }
+    constexpr char back() const { return data_[N - 1]; }
+
+    constexpr operator StringView() const noexcept { return { data_, N }; }
+    std::string str() const { return { data_, N }; }
+
+    template <std::size_t M>
+    constexpr ConstString<N + M> operator+(const ConstString<M> & rhs) const
+    {
+        return ConstString<N + M>(
+                   *this, typename Private::MakeIndexList<N>::type(),
+                   rhs, typename Private::MakeIndexList<M>::type());
+    }
+
+private:
+    template <std::size_t... indices>
+    constexpr ConstString(const char (& literal)[N + 1],
+                          Private::IndexList<indices...>)
+        : data_ { literal[indices]..., '\0' } {}
+
+    template <std::size_t L, std::size_t... lIndices,
+              std::size_t R, std::size_t... rIndices>
+    constexpr ConstString(const ConstString<L> & lhs,
+                          Private::IndexList<lIndices...>,
+                          const ConstString<R> & rhs,
+                          Private::IndexList<rIndices...>)
+        : data_ { lhs.data_[lIndices]..., rhs.data_[rIndices]..., '\0' } {}
+
+    template <std::size_t> friend class ConstString;
+
+    char data_[N + 1];
+};
+
+/// @return ConstString that holds a copy of literal.
+template <std::size_t size>
+constexpr ConstString<size - 1> makeConstString(const char (& literal)[size])
+{
+    return ConstString<size - 1>(literal);
+}
+
+template <std::size_t N>
+std::string operator+(const std::string & lhs, const ConstString<N> & rhs)
+{
+    return std::string(lhs).append(rhs.data(), N);
+}
+
+template <std::size_t N>
+std::string operator+(const ConstString<N> & lhs, const std::string & rhs)
+{
+    return lhs.str() + rhs;
+}
+
+template <std::size_t N>
+std::string operator+(const char * lhs, const ConstString<N> & rhs)
+{
+    return std::string(lhs).append(rhs.data(), N);
+}
+
+} // END namespace CommonUtilities
+
+# endif // COMMON_UTILITIES_CONST_STRING_HPP
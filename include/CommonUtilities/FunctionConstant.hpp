@@ -34,4 +34,17 @@ keyword const Type & name()                                                 \
 # define CLASS_FUNCTION_CONSTANT(Type, name, value) \
     PRIVATE_FC_KEYWORDED_FUNCTION_CONSTANT(static, Type, name, value)
 
+
+/// Constexpr variants: value must be a constant expression, e.g. a
+/// ConstString. It is computed at compile time, so there is no function-local
+/// static, no initialization guard and no dynamic allocation.
+# define PRIVATE_FC_KEYWORDED_CONSTEXPR_CONSTANT(keyword, name, value) \
+keyword constexpr decltype(value) name() { return value; }
+
+# define NAMESPACE_CONSTEXPR_FUNCTION_CONSTANT(name, value) \
+    PRIVATE_FC_KEYWORDED_CONSTEXPR_CONSTANT(inline, name, value)
+
+# define CLASS_CONSTEXPR_FUNCTION_CONSTANT(name, value) \
+    PRIVATE_FC_KEYWORDED_CONSTEXPR_CONSTANT(static, name, value)
+
 # endif // COMMON_UTILITIES_FUNCTION_CONSTANT_HPP
@@ -0,0 +1,79 @@
+/*
+ This file is part of vedgTools/CommonUtilities.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/CommonUtilities is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/CommonUtilities is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/CommonUtilities.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# ifndef COMMON_UTILITIES_HASH_HPP
+# define COMMON_UTILITIES_HASH_HPP
+
+# include "StringView.hpp"
+
+# include <cstddef>
+# include <cstdint>
+# include <string>
+
+
+namespace CommonUtilities
+{
+/// @brief 64-bit FNV-1a hash. Is not cryptographic, but is good enough to
+/// detect changes in file contents.
+class Fnv1aHash
+{
+public:
+    typedef std::uint64_t Value;
+
+    /// @brief Hashes bytes of data as if they were appended to previous data.
+    Fnv1aHash & add(StringView data) noexcept {
+        for (char c : data) {
+            value_ ^= static_cast<unsigned char>(c);
+            value_ *= 1099511628211ull;
+        }
+        return *this;
+    }
+
+    /// @brief Hashes size of data, then data. Thus sequences of fields are
+    /// distinguished regardless of where their boundaries are.
+    Fnv1aHash & addField(StringView data) noexcept {
+        Value size = data.size();
+        for (int i = 0; i < 8; ++i, size >>= 8) {
+            value_ ^= size & 0xFF;
+            value_ *= 1099511628211ull;
+        }
+        return add(data);
+    }
+
+    Value value() const noexcept { return value_; }
+
+    /// @return Hash of data.
+    static Value of(StringView data) noexcept {
+        return Fnv1aHash().add(data).value();
+    }
+
+    /// @return 16 lowercase hexadecimal digits of value.
+    static std::string toHex(Value value) {
+        std::string result(16, '0');
+        for (std::size_t i = result.size(); i-- > 0; value >>= 4)
+            result[i] = "0123456789abcdef"[value & 0xF];
+        return result;
+    }
+
+private:
+    Value value_ = 14695981039346656037ull;
+};
+
+} // END namespace CommonUtilities
+
+# endif // COMMON_UTILITIES_HASH_HPP
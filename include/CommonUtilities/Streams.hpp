@@ -19,10 +19,29 @@
 # ifndef COMMON_UTILITIES_STREAMS_HPP
 # define COMMON_UTILITIES_STREAMS_HPP
 
+# include "CopyAndMoveSemantics.hpp"
+# include "StringView.hpp"
+
+# include <cstddef>
+# include <cstdio>
 # include <string>
+# include <atomic>
+# include <istream>
 # include <sstream>
 # include <fstream>
 
+# if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+#   define COMMON_UTILITIES_HAS_MMAP 1
+#   include <cerrno>
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#   include <sys/mman.h>
+# else
+#   define COMMON_UTILITIES_HAS_MMAP 0
+# endif
+
 
 namespace CommonUtilities
 {
@@ -33,9 +52,120 @@ inline std::string getFileContents(const std::istream & stream)
     return buffer.str();
 }
 
+
+/// @brief Read-only contiguous view of the whole contents of a file.
+/// Nonempty regular files are memory-mapped. Other files (pipes, terminals,
+/// /dev/stdin) are read into an internal buffer. On platforms without mmap()
+/// all files are read into the buffer.
+class MappedFile
+{
+public:
+    enum Mode
+    {
+        mapIfPossible,
+        /// Reading is safe even if the file can be truncated by someone else
+        /// while this object exists (accessing truncated mapping raises
+        /// SIGBUS).
+        readIntoBuffer
+    };
+
+    /// @brief Maps or reads file filename. If reading fails, contents are
+    /// empty and isFine() returns false.
+    explicit MappedFile(const std::string & filename,
+                        Mode mode = mapIfPossible);
+    /// @brief Reads stream till the end into the internal buffer.
+    explicit MappedFile(std::istream & stream);
+
+    NEITHER_COPYABLE_NOR_MOVABLE(MappedFile)
+    ~MappedFile() noexcept;
+
+    /// @return true if the whole file was mapped or read successfully.
+    bool isFine() const { return fine_; }
+
+    /// @return Contents of the file. Valid during the lifetime of this object.
+    StringView view() const { return { data_, size_ }; }
+
+private:
+    void useBuffer() { data_ = buffer_.data(); size_ = buffer_.size(); }
+
+    std::string buffer_;
+    const char * data_ = nullptr;
+    std::size_t size_ = 0;
+    bool mapped_ = false;
+    bool fine_ = false;
+};
+
+inline MappedFile::MappedFile(std::istream & stream)
+    : buffer_(getFileContents(stream)), fine_(! stream.bad())
+{
+    useBuffer();
+}
+
+# if COMMON_UTILITIES_HAS_MMAP
+inline MappedFile::MappedFile(const std::string & filename, Mode mode)
+{
+    int fd;
+    do
+        fd = ::open(filename.c_str(), O_RDONLY);
+    while (fd == -1 && errno == EINTR);
+    if (fd == -1)
+        return;
+
+    struct stat status;
+    if (mode == mapIfPossible && ::fstat(fd, & status) == 0 &&
+            S_ISREG(status.st_mode) && status.st_size > 0) {
+        const std::size_t size = static_cast<std::size_t>(status.st_size);
+        void * const address =
+            ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            data_ = static_cast<const char *>(address);
+            size_ = size;
+            mapped_ = fine_ = true;
+            ::close(fd);
+            return;
+        }
+    }
+
+    // Not mappable -> read sequentially.
+    fine_ = true;
+    char chunk[1 << 16];
+    while (true) {
+        const ssize_t count = ::read(fd, chunk, sizeof(chunk));
+        if (count > 0)
+            buffer_.append(chunk, static_cast<std::size_t>(count));
+        else if (count == 0)
+            break;
+        else if (errno != EINTR) {
+            fine_ = false;
+            break;
+        }
+    }
+    ::close(fd);
+    useBuffer();
+}
+
+inline MappedFile::~MappedFile() noexcept
+{
+    if (mapped_)
+        ::munmap(const_cast<char *>(data_), size_);
+}
+# else
+inline MappedFile::MappedFile(const std::string & filename, Mode)
+{
+    std::ifstream stream(filename, std::ios_base::in | std::ios_base::binary);
+    buffer_ = getFileContents(stream);
+    fine_ = stream.is_open() && ! stream.bad();
+    useBuffer();
+}
+
+inline MappedFile::~MappedFile() noexcept = default;
+# endif
+
+
+/// NOTE: copies the file only once (from the mapping into the result).
 inline std::string getFileContents(const std::string & filename)
 {
-    return getFileContents(std::ifstream(filename));
+    return std::string(MappedFile(filename).view());
 }
 
 inline bool isStreamFine(const std::ifstream & ifs)
@@ -48,6 +178,59 @@ inline bool isStreamFine(const std::ostream & os)
     return static_cast<bool>(os);
 }
 
+/// @return Name of a new temporary file next to filename. The name is unique
+/// within this process and (where process ids are available) among processes.
+inline std::string temporaryFilename(const std::string & filename)
+{
+    static std::atomic<unsigned> tempFileCount(0);
+    std::string result = filename + ".tmp" + std::to_string(tempFileCount++);
+# if COMMON_UTILITIES_HAS_MMAP
+    result += '.' + std::to_string(::getpid());
+# endif
+    return result;
+}
+
+/// @brief Renames tempFilename to filename, replacing filename if it exists.
+/// Removes tempFilename in case of failure.
+/// @return false in case of failure; filename is not modified then.
+/// NOTE: on Windows, rename does not replace existing files, so filename is
+/// removed first; the replacement is not atomic there, and filename is lost
+/// if the second rename fails.
+inline bool replaceFile(const std::string & tempFilename,
+                        const std::string & filename)
+{
+    if (std::rename(tempFilename.c_str(), filename.c_str()) == 0)
+        return true;
+# ifdef _WIN32
+    std::remove(filename.c_str());
+    if (std::rename(tempFilename.c_str(), filename.c_str()) == 0)
+        return true;
+# endif
+    std::remove(tempFilename.c_str());
+    return false;
+}
+
+/// @brief Writes contents to a temporary file next to filename, then renames
+/// it to filename. Thus readers never see a partially written file.
+/// @return false in case of failure; filename is not modified then.
+inline bool replaceFileContents(const std::string & filename,
+                                StringView contents)
+{
+    const std::string tempFilename = temporaryFilename(filename);
+    {
+        std::ofstream file(tempFilename, std::ios_base::out |
+                           std::ios_base::binary | std::ios_base::trunc);
+        file.write(contents.data(),
+                   static_cast<std::streamsize>(contents.size()));
+        file.close();
+        if (! isStreamFine(file)) {
+            std::remove(tempFilename.c_str());
+            return false;
+        }
+    }
+    return replaceFile(tempFilename, filename);
+}
+
 } // END namespace CommonUtilities
 
 # endif // COMMON_UTILITIES_STREAMS_HPP
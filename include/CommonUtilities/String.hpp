@@ -19,10 +19,14 @@
 # ifndef COMMON_UTILITIES_STRING_HPP
 # define COMMON_UTILITIES_STRING_HPP
 
+# include "StringView.hpp"
+# include "CharScan.hpp"
+
 # include <cstddef>
 # include <cassert>
 # include <cctype>
 # include <utility>
+# include <iterator>
 # include <algorithm>
 # include <string>
 
@@ -99,9 +103,14 @@ inline void trim(std::string & str)
 }
 
 
+/// NOTE: functions below operate on StringView, so they can be applied to
+/// slices of any contiguous character buffer without copying. skip*() and
+/// Backward functions accept std::string through implicit conversion. They
+/// have no std::string overloads, because such overloads would make e.g.
+/// skipWs ambiguous when it is passed as a function.
+
 template <typename Predicate>
-inline void skipIf(const std::string & str, std::size_t & index,
-                   Predicate discarder)
+inline void skipIf(StringView str, std::size_t & index, Predicate discarder)
 {
     index = static_cast<std::size_t>(
                 std::find_if_not(
@@ -110,24 +119,34 @@ inline void skipIf(const std::string & str, std::size_t & index,
                 - str.begin());
 }
 
-inline void skipWs(const std::string & str, std::size_t & index)
+/// NOTE: skipWs(), skipWsExceptEol(), skipBlank(), Backward::findNonWs() and
+/// Backward::findEolOrNonWs() classify characters as std::isspace() and
+/// std::isblank() do in the "C" locale, regardless of current locale. This
+/// allows them to examine many characters at a time (see CharScan.hpp).
+
+inline void skipWs(StringView str, std::size_t & index)
 {
-    skipIf(str, index, SafeCtype<std::isspace>());
+    index = static_cast<std::size_t>(
+                CharScan::skip<CharScan::space>(str.begin() + index, str.end())
+                - str.begin());
 }
 
-inline void skipWsExceptEol(const std::string & str, std::size_t & index)
+inline void skipWsExceptEol(StringView str, std::size_t & index)
 {
-    skipIf(str, index, [](char c) {
-        return safeCtype<std::isspace>(c) && c != '\n';
-    });
+    index = static_cast<std::size_t>(
+                CharScan::skip<CharScan::spaceExceptEol>(
+                    str.begin() + index, str.end())
+                - str.begin());
 }
 
-inline void skipBlank(const std::string & str, std::size_t & index)
+inline void skipBlank(StringView str, std::size_t & index)
 {
-    skipIf(str, index, SafeCtype<std::isblank>());
+    index = static_cast<std::size_t>(
+                CharScan::skip<CharScan::blank>(str.begin() + index, str.end())
+                - str.begin());
 }
 
-inline void noSkip(const std::string &, std::size_t &) noexcept
+inline void noSkip(StringView, std::size_t &) noexcept
 {}
 
 
@@ -136,8 +155,8 @@ constexpr std::size_t npos() { return std::string::npos; }
 /// @brief Searches pattern in str.substr(start, end - start).
 /// @return Index of the beginning of pattern in str; npos() if pattern was not
 /// found in the range.
-inline std::size_t find(const std::string & str, std::size_t start,
-                        std::size_t end, const std::string & pattern)
+inline std::size_t find(StringView str, std::size_t start, std::size_t end,
+                        StringView pattern)
 {
     assert(start <= end);
     const auto endIt = str.begin() + static_cast<std::ptrdiff_t>(end);
@@ -147,19 +166,70 @@ inline std::size_t find(const std::string & str, std::size_t start,
     return it == endIt ? npos() : static_cast<std::size_t>(it - str.begin());
 }
 
+inline std::size_t find(const std::string & str, std::size_t start,
+                        std::size_t end, const std::string & pattern)
+{
+    return find(StringView(str), start, end, StringView(pattern));
+}
+
+
+/// @brief Extracts the line that starts at index from source and moves index
+/// to the next line.
+/// @return false if there is no '\n' after index.
+inline bool readLine(StringView source, std::size_t & index, StringView & line)
+{
+    const std::size_t end = source.find('\n', index);
+    if (end == npos())
+        return false;
+    line = source.substr(index, end - index);
+    index = end + 1;
+    return true;
+}
+
+/// @brief Parses unsigned number written in the specified base (up to 16)
+/// with lowercase digits.
+/// @return false if str is empty or contains invalid digits.
+template <typename Unsigned>
+bool parseUnsigned(StringView str, unsigned base, Unsigned & value)
+{
+    if (str.empty() || str.size() > 20)
+        return false;
+    value = 0;
+    for (char c : str) {
+        unsigned digit;
+        if (c >= '0' && c <= '9')
+            digit = static_cast<unsigned>(c - '0');
+        else if (c >= 'a' && c <= 'f')
+            digit = static_cast<unsigned>(c - 'a' + 10);
+        else
+            return false;
+        if (digit >= base)
+            return false;
+        value = static_cast<Unsigned>(value * base + digit);
+    }
+    return true;
+}
+
 
 /// @return true if (lhs.substr(lhsPos, rhs.size()) == rhs).
-/// NOTE: is safe to call if lhs.size() < lhsPos + rhs.size(). Returns false in
-/// this case.
+/// NOTE: is safe to call if lhs.size() < lhsPos + rhs.size() or even if
+/// lhs.size() < lhsPos. Returns false in these cases.
+inline bool equalSubstr(StringView lhs, std::size_t lhsPos, StringView rhs)
+{
+    return lhsPos <= lhs.size() && rhs.size() <= lhs.size() - lhsPos &&
+           std::equal(rhs.begin(), rhs.end(),
+                      lhs.begin() + static_cast<std::ptrdiff_t>(lhsPos));
+}
+
 inline bool equalSubstr(const std::string & lhs, std::size_t lhsPos,
                         const std::string & rhs)
 {
-    return lhs.compare(lhsPos, rhs.size(), rhs) == 0;
+    return equalSubstr(StringView(lhs), lhsPos, StringView(rhs));
 }
 
 namespace Backward
 {
-using RevIt = std::string::const_reverse_iterator;
+using RevIt = std::reverse_iterator<StringView::const_iterator>;
 
 /// @brief Locates the specified by locator entity in the
 /// range = str.substr(start, end - start) backwards.
@@ -168,11 +238,11 @@ using RevIt = std::string::const_reverse_iterator;
 /// @return Index of the last occurence of entity in str (within range) or
 /// npos() if entity was not found in range.
 template <typename Locator>
-std::size_t locate(const std::string & str, std::size_t start, std::size_t end,
+std::size_t locate(StringView str, std::size_t start, std::size_t end,
                    Locator locator)
 {
     assert(start <= end);
-    const RevIt rEnd = str.rend();
+    const RevIt rEnd(str.begin());
     const std::size_t result =
         static_cast<std::size_t>(
             rEnd - locator(rEnd - static_cast<std::ptrdiff_t>(end),
@@ -183,8 +253,8 @@ std::size_t locate(const std::string & str, std::size_t start, std::size_t end,
 /// @brief Searches character c in str.substr(start, end - start) backwards.
 /// @return Index of the last character c in str (within range); npos() if c was
 /// not found in the range.
-inline std::size_t find(const std::string & str, std::size_t start,
-                        std::size_t end, char c)
+inline std::size_t find(StringView str, std::size_t start, std::size_t end,
+                        char c)
 {
     return locate(str, start, end, [&](RevIt b, RevIt e) {
         return std::find(b, e, c);
@@ -196,7 +266,7 @@ inline std::size_t find(const std::string & str, std::size_t start,
 /// @return Index of the last matching character in str (within range); npos()
 /// if matching character was not found in the range.
 template <typename Predicate>
-std::size_t findIf(const std::string & str, std::size_t start, std::size_t end,
+std::size_t findIf(StringView str, std::size_t start, std::size_t end,
                    Predicate predicate)
 {
     return locate(str, start, end, [&](RevIt b, RevIt e) {
@@ -209,26 +279,39 @@ std::size_t findIf(const std::string & str, std::size_t start, std::size_t end,
 /// @return Index of the last matching character in str (within range); npos()
 /// if matching character was not found in the range.
 template <typename Predicate>
-std::size_t findIfNot(const std::string & str, std::size_t start,
-                      std::size_t end, Predicate predicate)
+std::size_t findIfNot(StringView str, std::size_t start, std::size_t end,
+                      Predicate predicate)
 {
     return locate(str, start, end, [&](RevIt b, RevIt e) {
         return std::find_if_not(b, e, std::move(predicate));
     });
 }
 
-inline std::size_t findNonWs(const std::string & str, std::size_t start,
+/// @brief Searches character that does not belong to cls in
+/// str.substr(start, end - start) backwards.
+/// @return Index of the last such character in str (within range); npos() if
+/// there is no such character in the range.
+template <CharScan::Class cls>
+std::size_t findNotIn(StringView str, std::size_t start, std::size_t end)
+{
+    assert(start <= end);
+    const std::size_t result = static_cast<std::size_t>(
+                                   CharScan::skipBackward<cls>(
+                                       str.begin() + start, str.begin() + end)
+                                   - str.begin());
+    return result == start ? npos() : result - 1;
+}
+
+inline std::size_t findNonWs(StringView str, std::size_t start,
                              std::size_t end)
 {
-    return findIfNot(str, start, end, SafeCtype<std::isspace>());
+    return findNotIn<CharScan::space>(str, start, end);
 }
 
-inline std::size_t findEolOrNonWs(const std::string & str, std::size_t start,
+inline std::size_t findEolOrNonWs(StringView str, std::size_t start,
                                   std::size_t end)
 {
-    return findIf(str, start, end, [](char c) {
-        return c == '\n' || ! safeCtype<std::isspace>(c);
-    });
+    return findNotIn<CharScan::spaceExceptEol>(str, start, end);
 }
 
 } // END namespace Backward
@@ -0,0 +1,138 @@
+/*
+ This file is part of vedgTools/CommonUtilities.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/CommonUtilities is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/CommonUtilities is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/CommonUtilities.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# ifndef COMMON_UTILITIES_STRING_VIEW_HPP
+# define COMMON_UTILITIES_STRING_VIEW_HPP
+
+# include <cstddef>
+# include <cstring>
+# include <cassert>
+# include <algorithm>
+# include <string>
+# include <ostream>
+
+
+namespace CommonUtilities
+{
+/// @brief Non-owning reference to a contiguous sequence of characters.
+/// Subset of C++17 std::string_view interface. Search functions return
+/// std::string::npos if nothing was found, so results can be compared with
+/// values returned by std::string.
+/// WARNING: referenced characters must outlive StringView.
+class StringView
+{
+public:
+    typedef const char * const_iterator;
+
+    constexpr StringView() noexcept : data_(nullptr), size_(0) {}
+    constexpr StringView(const char * data, std::size_t size) noexcept
+        : data_(data), size_(size) {}
+    StringView(const char * str) : data_(str), size_(std::strlen(str)) {}
+    StringView(const std::string & str) noexcept
+        : data_(str.data()), size_(str.size()) {}
+
+    explicit operator std::string() const { return { data_, size_ }; }
+
+    constexpr const char * data() const noexcept { return data_; }
+    constexpr std::size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+
+    constexpr const_iterator begin() const noexcept { return data_; }
+    constexpr const_iterator end() const noexcept { return data_ + size_; }
+
+    constexpr char operator[](std::size_t pos) const { return data_[pos]; }
+    char front() const { assert(! empty()); return data_[0]; }
+    char back() const { assert(! empty()); return data_[size_ - 1]; }
+
+    /// @return View of [pos, pos + min(n, size() - pos)).
+    /// NOTE: unlike std::string::substr(), pos > size() is not checked.
+    StringView substr(std::size_t pos,
+                      std::size_t n = std::string::npos) const {
+        assert(pos <= size_);
+        return { data_ + pos, std::min(n, size_ - pos) };
+    }
+
+    std::size_t find(char c, std::size_t pos = 0) const {
+        if (pos >= size_)
+            return std::string::npos;
+        const void * const found = std::memchr(data_ + pos, c, size_ - pos);
+        return found == nullptr ? std::string::npos :
+               static_cast<std::size_t>(static_cast<const char *>(found) -
+                                        data_);
+    }
+
+    std::size_t find(StringView str, std::size_t pos = 0) const {
+        if (pos > size_ || str.size_ > size_ - pos)
+            return std::string::npos;
+        const const_iterator it = std::search(begin() + pos, end(),
+                                              str.begin(), str.end());
+        return it == end() && ! str.empty() ?
+               std::string::npos : static_cast<std::size_t>(it - data_);
+    }
+
+    std::size_t find_first_of(StringView chars, std::size_t pos = 0) const {
+        if (pos >= size_)
+            return std::string::npos;
+        const const_iterator it = std::find_first_of(begin() + pos, end(),
+                                                     chars.begin(),
+                                                     chars.end());
+        return it == end() ?
+               std::string::npos : static_cast<std::size_t>(it - data_);
+    }
+
+    /// @return Same as std::string(*this).compare(pos, n, str).
+    int compare(std::size_t pos, std::size_t n, StringView str) const {
+        return substr(pos, n).compare(str);
+    }
+
+    int compare(StringView str) const {
+        const std::size_t n = std::min(size_, str.size_);
+        const int result = n == 0 ? 0 : std::memcmp(data_, str.data_, n);
+        if (result != 0)
+            return result;
+        return size_ < str.size_ ? -1 : (size_ == str.size_ ? 0 : 1);
+    }
+
+private:
+    const char * data_;
+    std::size_t size_;
+};
+
+inline bool operator==(StringView lhs, StringView rhs)
+{
+    return lhs.size() == rhs.size() && lhs.compare(rhs) == 0;
+}
+
+inline bool operator!=(StringView lhs, StringView rhs)
+{
+    return ! (lhs == rhs);
+}
+
+inline std::ostream & operator<<(std::ostream & os, StringView str)
+{
+    return os.write(str.data(), static_cast<std::streamsize>(str.size()));
+}
+
+inline std::string & operator+=(std::string & lhs, StringView rhs)
+{
+    return lhs.append(rhs.data(), rhs.size());
+}
+
+} // END namespace CommonUtilities
+
+# endif // COMMON_UTILITIES_STRING_VIEW_HPP
@@ -0,0 +1,679 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/// include_expander_benchmark [corpus-dir [iterations]]
+/// Generates synthetic corpora in corpus-dir and reports throughput, latency
+/// percentiles and heap allocations per call of IncludeExpander and of each
+/// Pattern subclass.
+/// IncludeExpander cases:
+/// "expand" - expansion of a CMake file with a fresh module cache (includes
+/// reading and expanding all modules it needs);
+/// "expand (cached)" - the same with all modules already expanded, i.e. only
+/// the search of includes and boilerplate in the file and splicing;
+/// Inputs "sweep_N.txt" have N lines and N / 100 includes of distinct
+/// modules; expansion time should grow linearly with N, so their MB/s should
+/// be about the same.
+/// "expandIncludes" - preExpandModules() of the whole corpus directory, i.e.
+/// expansion of includes in every module;
+/// "expand jobs" - batch expansion of a few hundred CMake files that share
+/// modules, with a fresh module cache and 1, 2, 4... hardware threads.
+/// Pattern cases marked "(scalar)" measure the std::tolower()-based
+/// case-insensitive matching that CaseFold replaced. Their matches are
+/// checked against the current patterns.
+/// Matcher cases match IncludeExpander's include and boilerplate sequences
+/// with PatternMatcher and with StaticPatternMatcher; their captured
+/// positions and params are checked to be equal.
+
+# include "IncludeExpander.hpp"
+# include "PatternUtilities.hpp"
+
+# include <CommonUtilities/StringView.hpp>
+# include <CommonUtilities/Streams.hpp>
+
+# include <cstddef>
+# include <cstdlib>
+# include <cctype>
+# include <new>
+# include <utility>
+# include <algorithm>
+# include <functional>
+# include <array>
+# include <thread>
+# include <vector>
+# include <string>
+# include <chrono>
+# include <atomic>
+# include <iostream>
+# include <iomanip>
+# include <fstream>
+
+# if defined(__unix__) || defined(__APPLE__)
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#   define BENCHMARK_POSIX 1
+# else
+#   define BENCHMARK_POSIX 0
+# endif
+
+
+namespace
+{
+using CommonUtilities::StringView;
+using namespace PatternUtilities;
+
+/// Number of operator new calls since the start of the program.
+std::atomic<std::size_t> allocationCount(0);
+
+/// Numbers of lines in the inputs of the size sweep.
+const int sweepLineCounts[] = { 20000, 40000, 80000 };
+
+/// Names of sources for pattern cases in the order of generation.
+const char * const sourceNames[] = {
+    "long_file", "non_matching", "boilerplate"
+};
+
+/// Compares chars through std::tolower() like CiString did before CaseFold.
+struct CtypeCiCharComparator {
+    bool operator()(char lower, char mixed) const {
+        return CommonUtilities::safeCtypeCast(lower) ==
+               safeCtype<std::tolower>(mixed);
+    }
+};
+
+/// SearchCiStringLine as it was before CaseFold: finds the first symbol in
+/// either case, then compares the rest char by char.
+class ScalarSearchCiStringLine final : public SearchLine
+{
+public:
+    explicit ScalarSearchCiStringLine(const std::string & lowerStr)
+        : lowerStrWithoutFirstSymbol_(lowerStr.substr(1)) {
+        const char lower = lowerStr.front();
+        const char upper = static_cast<char>(safeCtype<std::toupper>(lower));
+        if (lower == upper)
+            firstSymbol_ = { lower };
+        else
+            firstSymbol_ = { lower, upper };
+    }
+
+    bool match(StringView source, std::size_t & index) override {
+        return matchLine(*this, source, index);
+    }
+
+    void findStr(StringView source, std::size_t & index) const {
+        while ((index = source.find_first_of(firstSymbol_, index))
+                != std::string::npos) {
+            if (matchesAt<CtypeCiCharComparator>(
+                        source, index + 1, lowerStrWithoutFirstSymbol_)) {
+                break;
+            }
+            ++index;
+            index = source.find('\n', index);
+            if (index == std::string::npos)
+                break;
+            ++index;
+        }
+    }
+
+    std::size_t size() const {
+        return lowerStrWithoutFirstSymbol_.size() + 1;
+    }
+
+private:
+    std::string firstSymbol_;
+    const std::string lowerStrWithoutFirstSymbol_;
+};
+
+/// Patterns of IncludeExpander's include and boilerplate sequences, which
+/// are matched both by PatternMatcher and by StaticPatternMatcher.
+struct Sequences {
+    typedef StaticString<SkipWs> WsString;
+    typedef StaticString<SkipBlank> BlankString;
+    typedef StaticCiString<SkipWs> WsCiString;
+
+    SearchKeywordLine startInclude {
+        "include", SearchKeywordLine::caseInsensitive
+    };
+    WsString startSeparator { "(" };
+    WsString libraryPrefix { "vedgTools/" };
+    BasicParam<NoSkip> filename;
+    WsString endSeparator { ")" };
+
+    SearchKeywordLine startBoilerplate { "##" };
+    std::array<BlankString, 3> directiveBoilerplate {{
+            BlankString("vedgTools/CMakeModules"),
+            BlankString("path"),
+            BlankString("boilerplate")
+        }
+    };
+    SearchSymbol searchEndOfLine { '\n' };
+    WsCiString includeCommand { "include" };
+    std::array<WsString, 2> includeBoilerplate {{
+            WsString("OPTIONAL"),
+            WsString("RESULT_VARIABLE")
+        }
+    };
+    BasicParam<SkipWs> wasIncluded;
+    WsCiString if_ { "if" };
+    BasicParamCopy<SkipWs> wasIncludedCopy { wasIncluded };
+    std::array<WsString, 2> ifVars {{
+            WsString("STREQUAL"), WsString("NOTFOUND")
+        }
+    };
+    SearchKeywordLine endif { "endif", SearchKeywordLine::caseInsensitive };
+    SearchSymbol searchEndSeparator { ')' };
+
+    typedef StaticPatternMatcher<
+        SearchKeywordLine, WsString, WsString, BasicParam<NoSkip>,
+        WsString> IncludeMatcher;
+    IncludeMatcher makeIncludeMatcher() {
+        return IncludeMatcher(startInclude, startSeparator, libraryPrefix,
+                              filename, endSeparator);
+    }
+    PatternMatcher::PatternSequence includeSequence() {
+        return { &startInclude, &startSeparator, &libraryPrefix, &filename,
+                 &endSeparator };
+    }
+
+    typedef StaticPatternMatcher<
+        SearchKeywordLine, std::array<BlankString, 3>, SearchSymbol,
+        WsCiString, WsString, WsString, BasicParam<NoSkip>,
+        std::array<WsString, 2>, BasicParam<SkipWs>, WsString,
+        WsCiString, WsString, BasicParamCopy<SkipWs>,
+        std::array<WsString, 2>, WsString,
+        SearchKeywordLine, SearchSymbol> BoilerplateMatcher;
+    BoilerplateMatcher makeBoilerplateMatcher() {
+        return BoilerplateMatcher(
+                   startBoilerplate, directiveBoilerplate, searchEndOfLine,
+                   includeCommand, startSeparator, libraryPrefix, filename,
+                   includeBoilerplate, wasIncluded, endSeparator,
+                   if_, startSeparator, wasIncludedCopy, ifVars,
+                   endSeparator,
+                   endif, searchEndSeparator);
+    }
+    PatternMatcher::PatternSequence boilerplateSequence() {
+        return {
+            &startBoilerplate, &directiveBoilerplate[0],
+            &directiveBoilerplate[1], &directiveBoilerplate[2],
+            &searchEndOfLine,
+            &includeCommand, &startSeparator, &libraryPrefix, &filename,
+            &includeBoilerplate[0], &includeBoilerplate[1], &wasIncluded,
+            &endSeparator,
+            &if_, &startSeparator, &wasIncludedCopy, &ifVars[0], &ifVars[1],
+            &endSeparator,
+            &endif, &searchEndSeparator
+        };
+    }
+
+    /// @brief Matches matcher repeatedly in source from the position where
+    /// the previous attempt stopped, like IncludeExpander does. Calls
+    /// capture(matched) after each attempt that matched at least one
+    /// pattern.
+    template <class Matcher, class Capture>
+    void matchAll(Matcher & matcher, StringView source, std::size_t & index,
+                  Capture capture) {
+        std::size_t prevIndex = 0;
+        index = 0;
+        while (index < source.size()) {
+            startInclude.setLineBoundary(prevIndex);
+            matcher.reset();
+            const bool matched = matcher.match(source, index);
+            if (matcher.currentPatternIndex() == 0)
+                break;
+            capture(matched);
+            if (matched)
+                prevIndex = index;
+        }
+    }
+};
+
+class Benchmark
+{
+public:
+    explicit Benchmark(std::string corpusDir, unsigned iterations)
+        : dir_(std::move(corpusDir)), iterations_(iterations) {}
+
+    /// @brief Writes all corpora to dir_.
+    /// @return false in case of filesystem error.
+    bool generateCorpora();
+
+    void runExpanderCases();
+    /// @return false if a scalar pattern's matches differ from the matches
+    /// of the pattern that replaced it.
+    bool runPatternCases();
+    /// @return false if PatternMatcher and StaticPatternMatcher capture
+    /// different positions or params.
+    bool runMatcherCases();
+
+private:
+    /// @brief Writes contents to dir_ + name.
+    void write(const std::string & name, const std::string & contents);
+
+    /// @brief Calls function iterations_ times and prints statistics.
+    /// @param bytes Size of data processed by each call.
+    void measure(const std::string & name, std::size_t bytes,
+                 const std::function<void()> & function) const;
+
+    /// @brief Measures all IncludeExpander cases for dir_ + input.
+    void measureExpander(const std::string & input);
+
+    /// @brief Measures pattern by matching it repeatedly in each source.
+    /// Search* patterns are matched from the position after the previous
+    /// match; other patterns are matched at the beginning of each line.
+    /// @return Number of matches in each source.
+    std::vector<std::size_t> measurePattern(const std::string & name,
+                                            Pattern & pattern, bool isSearch);
+
+    /// @brief Measures matcher in each source (see Sequences::matchAll()).
+    /// @return Captures in all sources: for each attempt, the number of
+    /// matched patterns, index after the attempt and, if the whole sequence
+    /// matched, the params.
+    template <class Matcher>
+    std::vector<std::string> measureMatcher(const std::string & name,
+                                            Sequences & sequences,
+                                            Matcher & matcher);
+
+    std::string dir_;
+    unsigned iterations_;
+    bool fine_ = true;
+    /// Sources for pattern cases.
+    std::vector<std::string> sources_;
+    /// Batch for thread scaling cases.
+    std::vector<IncludeExpander::Job> jobs_;
+    std::size_t jobBytes_ = 0;
+};
+
+
+bool Benchmark::generateCorpora()
+{
+    if (! dir_.empty() && dir_.back() != '/')
+        dir_ += '/';
+# if BENCHMARK_POSIX
+    ::mkdir(dir_.c_str(), 0777);
+# endif
+    const std::string cmakeLines =
+        "set(SOURCES main.cpp widget.cpp model.cpp)\n"
+        "    if(CMAKE_COMPILER_IS_GNUCXX)\n"
+        "        add_definitions(-Wall -Wextra)\n"
+        "    endif()\n"
+        "# comment that mentions include but is not an include\n";
+
+    // Many small modules, each included by the input once.
+    const int manyModuleCount = 1000;
+    std::string input = "cmake_minimum_required(VERSION 2.8)\n";
+    for (int i = 0; i < manyModuleCount; ++i) {
+        const std::string name = "Many" + std::to_string(i);
+        write(name + ".cmake", cmakeLines + cmakeLines);
+        input += "include(vedgTools/" + name + ")\n" + cmakeLines;
+    }
+    write("many_modules.txt", input);
+
+    // A chain of modules: each one includes the next one.
+    const int depth = 200;
+    for (int i = 0; i < depth; ++i) {
+        std::string text = cmakeLines;
+        if (i + 1 < depth) {
+            text += "  include(vedgTools/Deep" + std::to_string(i + 1) +
+                    ")\n";
+        }
+        write("Deep" + std::to_string(i) + ".cmake", text + cmakeLines);
+    }
+    write("deep_nesting.txt", "include(vedgTools/Deep0)\n");
+
+    // A long file with few includes.
+    input.clear();
+    for (int i = 0; input.size() < (16u << 20); ++i) {
+        input += cmakeLines;
+        if (i % 20000 == 0) {
+            input += "include(vedgTools/Many" + std::to_string(i % 100) +
+                     ")\n";
+        }
+    }
+    write("long_file.txt", input);
+    sources_.push_back(input);
+
+    // Lines that look like includes but don't match.
+    input.clear();
+    for (int i = 0; i < 100000; ++i) {
+        const std::string n = std::to_string(i % manyModuleCount);
+        input += "include(other/Many" + n + ")\n";
+        input += "  includes(vedgTools/Many" + n + ")\n";
+        input += "set(x include(vedgTools/Many" + n + "))\n";
+        input += "include (vedgTools/Many" + n + "\n";
+    }
+    write("non_matching.txt", input);
+    sources_.push_back(input);
+
+    // Boilerplate directive followed by ordinary includes.
+    input =
+        "cmake_minimum_required(VERSION 2.8)\n"
+        "## vedgTools/CMakeModules path boilerplate\n"
+        "include(vedgTools/Many0 OPTIONAL RESULT_VARIABLE CMakeModulesFound)\n"
+        "if(CMakeModulesFound STREQUAL NOTFOUND)\n"
+        "    set(CMAKE_MODULE_PATH ${CMAKE_MODULE_PATH} ../CMakeModules)\n"
+        "    include(vedgTools/Many0)\n"
+        "endif()\n";
+    for (int i = 1; i < 50; ++i) {
+        input += cmakeLines + "include(vedgTools/Many" +
+                 std::to_string(i) + ")\n";
+    }
+    write("boilerplate.txt", input);
+    sources_.push_back(input);
+
+    // Inputs that grow in both size and number of included modules: one
+    // include per 100 lines.
+    for (int lineCount : sweepLineCounts) {
+        input.clear();
+        for (int i = 0; i < lineCount; i += 5) {
+            if (i % 100 == 0) {
+                input += "include(vedgTools/Many" +
+                         std::to_string(i / 100 % manyModuleCount) + ")\n";
+            }
+            input += cmakeLines;
+        }
+        write("sweep_" + std::to_string(lineCount) + ".txt", input);
+    }
+
+    // Many CMake files, each of which includes modules shared with others.
+    const int jobCount = 300;
+    for (int i = 0; i < jobCount; ++i) {
+        input = "cmake_minimum_required(VERSION 2.8)\n";
+        for (int k = 0; k < 20; ++k) {
+            input += "include(vedgTools/Many" +
+                     std::to_string((i * 7 + k * 50) % manyModuleCount) +
+                     ")\n" + cmakeLines;
+        }
+        input += "include(vedgTools/Deep" + std::to_string(i % depth) +
+                 ")\n";
+        const std::string name = dir_ + "Job" + std::to_string(i) + ".txt";
+        write("Job" + std::to_string(i) + ".txt", input);
+        jobs_.emplace_back(name, name + ".out");
+        jobBytes_ += input.size();
+    }
+
+    return fine_;
+}
+
+void Benchmark::runExpanderCases()
+{
+    for (const char * input : {
+                "many_modules.txt", "deep_nesting.txt", "long_file.txt",
+                "non_matching.txt", "boilerplate.txt"
+            }) {
+        measureExpander(input);
+    }
+    for (int lineCount : sweepLineCounts)
+        measureExpander("sweep_" + std::to_string(lineCount) + ".txt");
+
+    measure("expandIncludes [all modules]", 0, [this] {
+        IncludeExpander expander;
+        expander.preExpandModules(dir_);
+    });
+
+    const unsigned maxThreadCount =
+        std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned threadCount = 1; ; threadCount *= 2) {
+        threadCount = std::min(threadCount, maxThreadCount);
+        measure("expand jobs x" + std::to_string(jobs_.size()) + " [" +
+                std::to_string(threadCount) + " threads]", jobBytes_, [&] {
+            IncludeExpander expander;
+            expander(jobs_, dir_, threadCount);
+        });
+        if (threadCount == maxThreadCount)
+            break;
+    }
+}
+
+bool Benchmark::runPatternCases()
+{
+    bool same = true;
+    const auto compare = [&same](const std::string & name,
+                                 const std::vector<std::size_t> & scalar,
+                                 const std::vector<std::size_t> & current) {
+        if (scalar != current) {
+            std::cerr << name << " (scalar) matches differ." << std::endl;
+            same = false;
+        }
+    };
+
+    Whitespace whitespace;
+    measurePattern("Whitespace", whitespace, false);
+    String string("include", NoSkip());
+    measurePattern("String", string, false);
+    StaticString<SkipWs> staticString("include");
+    measurePattern("StaticString<SkipWs>", staticString, false);
+    CiString ciString("include", NoSkip());
+    GenericString<CtypeCiCharComparator> scalarCiString("include", NoSkip());
+    compare("CiString",
+            measurePattern("CiString (scalar)", scalarCiString, false),
+            measurePattern("CiString", ciString, false));
+    StaticCiString<SkipWs> staticCiString("include");
+    measurePattern("StaticCiString<SkipWs>", staticCiString, false);
+    Param param;
+    measurePattern("Param", param, false);
+    ParamCopy paramCopy(param);
+    measurePattern("ParamCopy", paramCopy, false);
+    SearchSymbol searchSymbol('(');
+    measurePattern("SearchSymbol", searchSymbol, true);
+    SearchStringLine searchStringLine("include");
+    measurePattern("SearchStringLine", searchStringLine, true);
+    for (const char * str : { "include", "endif", "if" }) {
+        SearchCiStringLine searchCiStringLine(str);
+        ScalarSearchCiStringLine scalarSearchCiStringLine(str);
+        const std::string name =
+            std::string("SearchCiStringLine(") + str + ')';
+        compare(name,
+                measurePattern(name + " (scalar)", scalarSearchCiStringLine,
+                               true),
+                measurePattern(name, searchCiStringLine, true));
+    }
+    SearchKeywordLine searchKeywordLine(
+        "include", SearchKeywordLine::caseInsensitive);
+    searchKeywordLine.addKeyword("endif", SearchKeywordLine::caseInsensitive);
+    measurePattern("SearchKeywordLine", searchKeywordLine, true);
+    return same;
+}
+
+bool Benchmark::runMatcherCases()
+{
+    Sequences sequences;
+    const PatternMatcher::PatternSequence includeSequence =
+        sequences.includeSequence();
+    PatternMatcher includeMatcher(includeSequence);
+    const std::vector<std::string> includeCaptures =
+        measureMatcher("PatternMatcher(include)", sequences, includeMatcher);
+    Sequences::IncludeMatcher staticIncludeMatcher =
+        sequences.makeIncludeMatcher();
+    const bool includeSame =
+        measureMatcher("StaticPatternMatcher(include)", sequences,
+                       staticIncludeMatcher) == includeCaptures;
+    if (! includeSame)
+        std::cerr << "include matcher captures differ." << std::endl;
+
+    const PatternMatcher::PatternSequence boilerplateSequence =
+        sequences.boilerplateSequence();
+    PatternMatcher boilerplateMatcher(boilerplateSequence);
+    const std::vector<std::string> boilerplateCaptures =
+        measureMatcher("PatternMatcher(boilerplate)", sequences,
+                       boilerplateMatcher);
+    Sequences::BoilerplateMatcher staticBoilerplateMatcher =
+        sequences.makeBoilerplateMatcher();
+    const bool boilerplateSame =
+        measureMatcher("StaticPatternMatcher(boilerplate)", sequences,
+                       staticBoilerplateMatcher) == boilerplateCaptures;
+    if (! boilerplateSame)
+        std::cerr << "boilerplate matcher captures differ." << std::endl;
+    return includeSame && boilerplateSame;
+}
+
+void Benchmark::write(const std::string & name, const std::string & contents)
+{
+    std::ofstream file(dir_ + name);
+    file << contents;
+    file.close();
+    if (! CommonUtilities::isStreamFine(file)) {
+        std::cerr << "Writing to file " << dir_ + name << " failed."
+                  << std::endl;
+        fine_ = false;
+    }
+}
+
+void Benchmark::measure(const std::string & name, std::size_t bytes,
+                        const std::function<void()> & function) const
+{
+    typedef std::chrono::steady_clock Clock;
+    std::vector<double> milliseconds;
+    milliseconds.reserve(iterations_);
+    const std::size_t allocationsBefore = allocationCount;
+    for (unsigned i = 0; i < iterations_; ++i) {
+        const Clock::time_point start = Clock::now();
+        function();
+        milliseconds.push_back(
+            std::chrono::duration<double, std::milli>(Clock::now() - start)
+            .count());
+    }
+    const std::size_t allocations =
+        (allocationCount - allocationsBefore) / iterations_;
+    std::sort(milliseconds.begin(), milliseconds.end());
+    const auto percentile = [&milliseconds](double fraction) {
+        const std::size_t index =
+            static_cast<std::size_t>(fraction * milliseconds.size());
+        return milliseconds[std::min(index, milliseconds.size() - 1)];
+    };
+
+    std::cout << std::left << std::setw(52) << name << std::right
+              << std::fixed << std::setprecision(3);
+    if (bytes != 0) {
+        std::cout << std::setw(10) << bytes / 1e3 / percentile(0.5)
+                  << " MB/s";
+    }
+    else
+        std::cout << std::setw(15) << "";
+    std::cout << "  p50 " << std::setw(9) << percentile(0.5)
+              << "  p90 " << std::setw(9) << percentile(0.9)
+              << "  p99 " << std::setw(9) << percentile(0.99) << " ms"
+              << "  allocs " << std::setw(8) << allocations << std::endl;
+}
+
+void Benchmark::measureExpander(const std::string & input)
+{
+    const std::size_t bytes =
+        CommonUtilities::MappedFile(dir_ + input).view().size();
+    const std::string output = dir_ + input + ".out";
+    measure("expand [" + input + ']', bytes, [&] {
+        IncludeExpander expander;
+        expander(dir_ + input, output, dir_);
+    });
+    IncludeExpander expander;
+    expander(dir_ + input, output, dir_);
+    measure("expand (cached) [" + input + ']', bytes, [&] {
+        expander(dir_ + input, output, dir_);
+    });
+}
+
+std::vector<std::size_t> Benchmark::measurePattern(const std::string & name,
+                                                   Pattern & pattern,
+                                                   bool isSearch)
+{
+    std::vector<std::size_t> matchCounts;
+    for (std::size_t s = 0; s < sources_.size(); ++s) {
+        const StringView source = sources_[s];
+        std::vector<std::size_t> lineBeginnings(1, 0);
+        for (std::size_t i = 0; i < source.size(); ++i) {
+            if (source[i] == '\n' && i + 1 < source.size())
+                lineBeginnings.push_back(i + 1);
+        }
+        std::size_t matchCount = 0;
+        measure(name + " [" + sourceNames[s] + ']', source.size(), [&] {
+            if (isSearch) {
+                std::size_t index = 0;
+                while (index < source.size() && pattern.match(source, index))
+                    ++matchCount;
+            }
+            else {
+                for (std::size_t lineBeginning : lineBeginnings) {
+                    std::size_t index = lineBeginning;
+                    matchCount += pattern.match(source, index);
+                }
+            }
+        });
+        matchCounts.push_back(matchCount);
+    }
+    return matchCounts;
+}
+
+template <class Matcher>
+std::vector<std::string> Benchmark::measureMatcher(const std::string & name,
+                                                   Sequences & sequences,
+                                                   Matcher & matcher)
+{
+    std::vector<std::string> captures;
+    for (std::size_t s = 0; s < sources_.size(); ++s) {
+        const StringView source = sources_[s];
+        std::size_t index;
+        measure(name + " [" + sourceNames[s] + ']', source.size(), [&] {
+            sequences.matchAll(matcher, source, index, [](bool) {});
+        });
+        sequences.matchAll(matcher, source, index, [&](bool matched) {
+            std::string capture =
+                std::to_string(matcher.currentPatternIndex()) + ' ' +
+                std::to_string(index);
+            if (matched) {
+                capture += ' ' + sequences.filename.getParam() + ' ' +
+                           sequences.wasIncluded.getParam();
+            }
+            captures.push_back(std::move(capture));
+        });
+    }
+    return captures;
+}
+
+} // END unnamed namespace
+
+
+void * operator new(std::size_t size)
+{
+    ++allocationCount;
+    if (void * const p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept
+{
+    std::free(p);
+}
+
+
+int main(int argc, char * argv[])
+{
+    const std::string corpusDir =
+        argc > 1 ? argv[1] : "include_expander_benchmark_corpus";
+    const int iterations = argc > 2 ? std::atoi(argv[2]) : 20;
+    if (iterations <= 0) {
+        std::cerr << "Usage: " << argv[0] << " [corpus-dir [iterations]]"
+                  << std::endl;
+        return 1;
+    }
+
+    Benchmark benchmark(corpusDir, static_cast<unsigned>(iterations));
+    if (! benchmark.generateCorpora())
+        return 5;
+    benchmark.runExpanderCases();
+    const bool patternsAgree = benchmark.runPatternCases();
+    return benchmark.runMatcherCases() && patternsAgree ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# include "DiskCache.hpp"
+
+# include "IncludeExpander.hpp"
+
+# include <CommonUtilities/StringView.hpp>
+# include <CommonUtilities/Hash.hpp>
+# include <CommonUtilities/Streams.hpp>
+# include <CommonUtilities/String.hpp>
+
+# include <cstddef>
+# include <utility>
+# include <string>
+
+# if defined(__unix__) || defined(__APPLE__)
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#   define DISK_CACHE_POSIX 1
+# else
+#   define DISK_CACHE_POSIX 0
+# endif
+
+
+namespace
+{
+using CommonUtilities::StringView;
+using CommonUtilities::Fnv1aHash;
+using CommonUtilities::String::readLine;
+using CommonUtilities::String::parseUnsigned;
+
+const std::string & header()
+{
+    static const std::string value =
+        "include_expander cache " + IncludeExpander::version() + '\n';
+    return value;
+}
+
+} // END unnamed namespace
+
+
+DiskCache::DiskCache(std::string dir) : dir_(std::move(dir))
+{
+    if (! dir_.empty() && dir_.back() != '/')
+        dir_ += '/';
+# if DISK_CACHE_POSIX
+    if (! dir_.empty())
+        ::mkdir(dir_.c_str(), 0777);
+# endif
+}
+
+DiskCache::Hash DiskCache::key(StringView kind, StringView name,
+                               StringView text)
+{
+    return Fnv1aHash().addField(IncludeExpander::version()).addField(kind)
+           .addField(name).addField(text).value();
+}
+
+bool DiskCache::load(Hash key, Entry & entry) const
+{
+    // Entries are never modified in place, so mapping them is safe.
+    const CommonUtilities::MappedFile file(entryPath(key));
+    if (! file.isFine())
+        return false;
+    const StringView source = file.view();
+    if (source.compare(0, header().size(), header()) != 0)
+        return false;
+
+    std::size_t index = header().size();
+    StringView line;
+    std::size_t count;
+    if (! readLine(source, index, line) || ! parseUnsigned(line, 10, count))
+        return false;
+    entry.dependencies.clear();
+    for (std::size_t i = 0; i < count; ++i) {
+        Hash hash;
+        if (! readLine(source, index, line) || line.size() < 18 ||
+                line[16] != ' ' ||
+                ! parseUnsigned(line.substr(0, 16), 16, hash)) {
+            return false;
+        }
+        entry.dependencies.emplace_back(std::string(line.substr(17)), hash);
+    }
+    std::size_t size;
+    if (! readLine(source, index, line) || ! parseUnsigned(line, 10, size) ||
+            source.size() - index != size) {
+        return false;
+    }
+    entry.contents.assign(source.data() + index, size);
+    return true;
+}
+
+void DiskCache::store(Hash key, const Entry & entry) const
+{
+    std::string data = header();
+    data += std::to_string(entry.dependencies.size());
+    data += '\n';
+    for (const auto & dependency : entry.dependencies) {
+        data += Fnv1aHash::toHex(dependency.second);
+        data += ' ';
+        data += dependency.first;
+        data += '\n';
+    }
+    data += std::to_string(entry.contents.size());
+    data += '\n';
+    data += entry.contents;
+    CommonUtilities::replaceFileContents(entryPath(key), data);
+}
+
+std::string DiskCache::entryPath(Hash key) const
+{
+    return dir_ + Fnv1aHash::toHex(key);
+}
@@ -0,0 +1,74 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# ifndef DISK_CACHE_HPP
+# define DISK_CACHE_HPP
+
+# include <CommonUtilities/StringView.hpp>
+# include <CommonUtilities/Hash.hpp>
+
+# include <utility>
+# include <vector>
+# include <string>
+
+
+/// @brief Persistent cache of expansion results. Each entry is a file in the
+/// cache directory named after the entry's key.
+/// Key is a hash of the tool version and of the text being expanded. Results
+/// also depend on the modules that were included during expansion, so each
+/// entry lists them together with hashes of their texts. The user of the
+/// cache must compare these hashes with current ones before using an entry.
+/// Entries are replaced atomically, so the same directory can be shared by
+/// concurrent processes.
+class DiskCache
+{
+public:
+    typedef CommonUtilities::Fnv1aHash::Value Hash;
+    /// (moduleName, hash of module's text)
+    typedef std::vector<std::pair<std::string, Hash>> Dependencies;
+
+    struct Entry {
+        std::string contents;
+        Dependencies dependencies;
+    };
+
+    /// @param dir Cache directory. Is created if it does not exist.
+    explicit DiskCache(std::string dir);
+
+    /// @param kind Distinguishes entries of different kinds (e.g. modules and
+    /// expanded CMake files).
+    /// @return Key of the entry that stores expansion result of text.
+    static Hash key(CommonUtilities::StringView kind,
+                    CommonUtilities::StringView name,
+                    CommonUtilities::StringView text);
+
+    /// @brief Reads entry with the specified key.
+    /// @return true if entry exists and is well-formed.
+    bool load(Hash key, Entry & entry) const;
+
+    /// @brief Writes entry with the specified key. Errors are ignored: the
+    /// entry is just not stored.
+    void store(Hash key, const Entry & entry) const;
+
+private:
+    std::string entryPath(Hash key) const;
+
+    std::string dir_;
+};
+
+# endif // DISK_CACHE_HPP
@@ -19,22 +19,43 @@
 # include "IncludeExpander.hpp"
 
 # include "PatternUtilities.hpp"
+# include "ModuleProvider.hpp"
+# include "ModuleBundle.hpp"
+# include "DiskCache.hpp"
+# include "Statistics.hpp"
 
+# include <CommonUtilities/StringView.hpp>
 # include <CommonUtilities/String.hpp>
 # include <CommonUtilities/Streams.hpp>
+# include <CommonUtilities/Hash.hpp>
+# include <CommonUtilities/Arena.hpp>
+# include <CommonUtilities/CopyAndMoveSemantics.hpp>
 
 # include <cstddef>
+# include <cstdio>
 # include <utility>
+# include <algorithm>
 # include <array>
+# include <vector>
 # include <map>
 # include <string>
 # include <stdexcept>
+# include <atomic>
+# include <mutex>
+# include <condition_variable>
+# include <thread>
+# include <deque>
+# include <memory>
+# include <ostream>
 # include <iostream>
 # include <fstream>
+# include <sstream>
 
 
 namespace
 {
+using CommonUtilities::StringView;
+
 class Error : public std::runtime_error
 {
 public:
@@ -42,165 +63,1259 @@ public:
     explicit Error(const std::string & sWhat) : std::runtime_error(sWhat) {}
 };
 
+/// @brief Prints error message to errors in case of filesystem error.
 /// @throw Error In case of filesystem error.
-void checkError(const std::ifstream & ifs, const std::string & filename)
+void checkError(const CommonUtilities::MappedFile & file,
+                const std::string & filename, std::ostream & errors)
 {
-    if (! CommonUtilities::isStreamFine(ifs)) {
-        std::cerr << "Reading file " << filename << " failed."
-                  << std::endl;
+    if (! file.isFine()) {
+        errors << "Reading file " << filename << " failed." << std::endl;
+        throw Error();
+    }
+}
+
+/// @brief Prints error message to errors if module moduleName was not found.
+/// @throw Error If module moduleName was not found.
+void checkError(const ModuleProvider::Text & text,
+                const ModuleProvider & provider,
+                const std::string & moduleName, std::ostream & errors)
+{
+    if (! text.found) {
+        const std::string filename = provider.filename(moduleName);
+        if (filename.empty())
+            errors << "Reading module " << moduleName;
+        else
+            errors << "Reading file " << filename;
+        errors << " failed." << std::endl;
         throw Error();
     }
 }
 
+/// @brief Prints error message to errors in case of filesystem error.
 /// @throw Error In case of filesystem error.
-void checkError(const std::ofstream & ofs, const std::string & filename)
+void checkError(const std::ofstream & ofs, const std::string & filename,
+                std::ostream & errors)
 {
     if (! CommonUtilities::isStreamFine(ofs)) {
-        std::cerr << "Writing to file " << filename << " failed."
-                  << std::endl;
+        errors << "Writing to file " << filename << " failed." << std::endl;
         throw Error();
     }
 }
 
+/// @brief Receives text chunk by chunk.
+class Sink
+{
+public:
+    virtual ~Sink() noexcept {}
+    virtual void write(StringView chunk) = 0;
+};
 
-/// @return Contents of the file (filename in dir).
-std::string getText(const std::string & dir, const std::string & filename)
+/// @brief Writes chunks to a stream.
+class StreamSink : public Sink
 {
-    const std::string absoluteName = dir + filename;
+public:
+    explicit StreamSink(std::ostream & stream) : stream_(stream) {}
 
-# ifdef DEBUG_INCLUDE_EXPANDER
-    std::cout << "Getting text of " << absoluteName << std::endl;
+    void write(StringView chunk) override {
+        stream_.write(chunk.data(),
+                      static_cast<std::streamsize>(chunk.size()));
+    }
+
+private:
+    std::ostream & stream_;
+};
+
+/// @brief Receives text chunk by chunk and writes it to file filename ("-"
+/// means std::cout). In alwaysWrite mode, the text is written straight into
+/// filename, so symlinks, FIFOs and devices work as outputs. In skipUnchanged
+/// mode, if filename is (or links to) a regular file, chunks are compared
+/// with it instead, and writing starts only at the first difference. A
+/// regular file is then written to a temporary file that replaces filename
+/// (keeping its permissions) in finish(), so filename is left untouched if
+/// finish() is not called.
+class OutputFile : public Sink
+{
+public:
+    explicit OutputFile(std::string filename,
+                        IncludeExpander::OutputMode outputMode);
+
+    NEITHER_COPYABLE_NOR_MOVABLE(OutputFile)
+    /// @brief Removes the temporary file if finish() was not called.
+    ~OutputFile();
+
+    void write(StringView chunk) override;
+
+    /// @brief Completes writing. Prints error message to errors in case of
+    /// filesystem error.
+    /// @return true if filename was left untouched because it already had
+    /// the written text.
+    /// @throw Error In case of filesystem error.
+    bool finish(std::ostream & errors);
+
+private:
+    /// @brief Opens filename or the temporary file and copies the matching
+    /// part of the existing file into it.
+    void startWriting();
+
+    const std::string filename_;
+    /// true if filename_ is replaced with a temporary file.
+    bool replace_ = false;
+    /// Permission bits of filename_ (when replace_ is true).
+    unsigned permissions_ = 0;
+    std::string tempFilename_;
+    std::ofstream file_;
+    std::ostream * stream_ = nullptr;
+    /// Existing file while written text matches it; nullptr otherwise.
+    std::unique_ptr<CommonUtilities::MappedFile> existing_;
+    /// Length of the written text (when existing_ is not nullptr).
+    std::size_t compared_ = 0;
+};
+
+OutputFile::OutputFile(std::string filename,
+                       IncludeExpander::OutputMode outputMode)
+    : filename_(std::move(filename))
+{
+    if (filename_ == "-") {
+        stream_ = &std::cout;
+        return;
+    }
+    if (outputMode == IncludeExpander::skipUnchanged) {
+        bool regular;
+# if COMMON_UTILITIES_HAS_MMAP
+        struct stat status;
+        regular = ::stat(filename_.c_str(), & status) == 0 &&
+                  S_ISREG(status.st_mode);
+        if (regular) {
+            permissions_ = static_cast<unsigned>(status.st_mode) & 07777u;
+            // A symlink is written through rather than replaced.
+            replace_ = ::lstat(filename_.c_str(), & status) == 0 &&
+                       S_ISREG(status.st_mode);
+        }
+# else
+        regular = replace_ = true;
+# endif
+        if (regular) {
+            existing_.reset(new CommonUtilities::MappedFile(filename_));
+            if (existing_->isFine())
+                return;
+            existing_.reset();
+        }
+    }
+    startWriting();
+}
+
+OutputFile::~OutputFile()
+{
+    if (! tempFilename_.empty()) {
+        file_.close();
+        std::remove(tempFilename_.c_str());
+    }
+}
+
+void OutputFile::write(StringView chunk)
+{
+    if (existing_ != nullptr) {
+        const StringView text = existing_->view();
+        if (chunk.size() <= text.size() - compared_ &&
+                text.substr(compared_, chunk.size()) == chunk) {
+            compared_ += chunk.size();
+            return;
+        }
+        startWriting();
+    }
+    stream_->write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+}
+
+bool OutputFile::finish(std::ostream & errors)
+{
+    if (existing_ != nullptr) {
+        if (compared_ == existing_->view().size()) {
+            existing_.reset();
+            return true;
+        }
+        startWriting();
+    }
+    if (stream_ == &std::cout) {
+        if (! std::cout.flush()) {
+            errors << "Writing to standard output failed." << std::endl;
+            throw Error();
+        }
+        return false;
+    }
+    file_.close();
+    if (! replace_) {
+        checkError(file_, filename_, errors);
+        return false;
+    }
+    const std::string tempFilename = std::move(tempFilename_);
+    tempFilename_.clear();
+    if (! CommonUtilities::isStreamFine(file_))
+        std::remove(tempFilename.c_str());
+    checkError(file_, filename_, errors);
+# if COMMON_UTILITIES_HAS_MMAP
+    ::chmod(tempFilename.c_str(), static_cast<mode_t>(permissions_));
 # endif
+    if (! CommonUtilities::replaceFile(tempFilename, filename_)) {
+        errors << "Writing to file " << filename_ << " failed." << std::endl;
+        throw Error();
+    }
+    return false;
+}
+
+void OutputFile::startWriting()
+{
+    const std::ios_base::openmode mode =
+        std::ios_base::out | std::ios_base::binary | std::ios_base::trunc;
+    if (replace_) {
+        tempFilename_ = CommonUtilities::temporaryFilename(filename_);
+        file_.open(tempFilename_, mode);
+    }
+    else
+        file_.open(filename_, mode);
+    stream_ = &file_;
+    if (existing_ != nullptr) {
+        file_.write(existing_->view().data(),
+                    static_cast<std::streamsize>(compared_));
+        existing_.reset();
+    }
+}
+
+/// @brief Expanded text that refers to included expanded texts instead of
+/// containing their copies. Thus a module included from many places is
+/// stored only once.
+struct ExpandedText {
+    /// @brief Included text that is spliced into ownText at position. Lines
+    /// of included text are prefixed with indent as IndentedWriter::write()
+    /// does.
+    struct Inclusion {
+        std::size_t position;
+        const ExpandedText * text;
+        std::string indent;
+    };
+
+    /// @return Size of the whole text after IndentedWriter::write() with
+    /// indent of size indentSize.
+    std::size_t indentedSize(std::size_t indentSize) const {
+        const std::size_t lineCount =
+            size == 0 ? 1 : 1 + newlineCount - endsWithNewline;
+        return size + indentSize * lineCount;
+    }
 
-    std::ifstream source(absoluteName);
-    std::string result = CommonUtilities::getFileContents(source);
-    checkError(source, absoluteName);
+    /// Text without included texts.
+    StringView ownText;
+    /// Sorted by position.
+    std::vector<Inclusion> inclusions;
+    /// Properties of the whole text.
+    std::size_t size = 0;
+    std::size_t newlineCount = 0;
+    bool endsWithNewline = false;
+};
+
+/// @return ExpandedText with included texts spliced into ownText.
+/// NOTE: the result refers to ownText and to included texts.
+ExpandedText makeExpandedText(
+    StringView ownText,
+    std::vector<ExpandedText::Inclusion> inclusions =
+        std::vector<ExpandedText::Inclusion>())
+{
+    ExpandedText result;
+    result.ownText = ownText;
+    result.size = ownText.size();
+    result.newlineCount = static_cast<std::size_t>(
+                              std::count(ownText.begin(), ownText.end(),
+                                         '\n'));
+    std::size_t position = 0;
+    for (const ExpandedText::Inclusion & inclusion : inclusions) {
+        if (inclusion.position != position) {
+            result.endsWithNewline = ownText[inclusion.position - 1] == '\n';
+            position = inclusion.position;
+        }
+        const ExpandedText & text = *inclusion.text;
+        result.size += text.indentedSize(inclusion.indent.size());
+        result.newlineCount += text.newlineCount;
+        // Empty text is replaced with indent.
+        if (text.size != 0)
+            result.endsWithNewline = text.endsWithNewline;
+        else if (! inclusion.indent.empty())
+            result.endsWithNewline = false;
+    }
+    if (position != ownText.size())
+        result.endsWithNewline = ownText.back() == '\n';
+    result.inclusions = std::move(inclusions);
     return result;
 }
 
+/// @brief Accumulates text. If sink is not nullptr, passes the text to it in
+/// chunks of about bufferSize bytes. Thus memory usage does not depend on the
+/// total size of the text. If inclusions are recorded, included texts are
+/// not copied: text() is then ExpandedText::ownText.
+class Output
+{
+public:
+    explicit Output(Sink * sink = nullptr) : sink_(sink) {}
+    explicit Output(std::vector<ExpandedText::Inclusion> & inclusions)
+        : sink_(nullptr), inclusions_(&inclusions) {}
+
+    Output & operator+=(StringView text) {
+        size_ += text.size();
+        if (sink_ != nullptr && buffer_.size() + text.size() > bufferSize) {
+            flush();
+            if (text.size() > bufferSize) {
+                // Big chunks (e.g. whole modules) are not copied.
+                sink_->write(text);
+                return *this;
+            }
+        }
+        buffer_ += text;
+        return *this;
+    }
+
+    Output & operator+=(char c) { return *this += StringView(&c, 1); }
+
+    /// @brief Appends text indented as IndentedWriter::write() does. Only
+    /// records the inclusion if inclusions are recorded.
+    void include(const ExpandedText & text, StringView indent);
+
+    /// @return Total size of the text.
+    std::size_t size() const { return size_; }
+
+    /// @return Accumulated text. Complete if sink is nullptr.
+    std::string & text() { return buffer_; }
+
+    /// @brief Passes accumulated text to sink.
+    void flush() {
+        sink_->write(buffer_);
+        buffer_.clear();
+    }
+
+private:
+    enum { bufferSize = 1 << 16 };
+
+    Sink * const sink_;
+    std::vector<ExpandedText::Inclusion> * const inclusions_ = nullptr;
+    std::string buffer_;
+    std::size_t size_ = 0;
+};
+
+/// @brief Writes ExpandedText, including nested texts, to output. Nested
+/// indents accumulate, so a line of a text nested at depth N is prefixed with
+/// N indents.
+class IndentedWriter
+{
+public:
+    explicit IndentedWriter(Output & output) : output_(output) {}
+
+    /// @brief Appends text to output. Prefixes each line of text with indent.
+    /// NOTE: if text is empty, indent is appended anyway.
+    void write(const ExpandedText & text, StringView indent) {
+        const std::size_t outerPrefixSize = prefix_.size();
+        prefix_.append(indent.data(), indent.size());
+        if (! indent.empty()) {
+            output_ += atLineStart_ ? StringView(prefix_) : indent;
+            atLineStart_ = false;
+        }
+        std::size_t position = 0;
+        for (const ExpandedText::Inclusion & inclusion : text.inclusions) {
+            writeLines(text.ownText.substr(
+                           position, inclusion.position - position));
+            write(*inclusion.text, inclusion.indent);
+            position = inclusion.position;
+        }
+        writeLines(text.ownText.substr(position));
+        prefix_.resize(outerPrefixSize);
+    }
+
+private:
+    /// @brief Appends text prefixing each line that starts in it with
+    /// prefix_.
+    void writeLines(StringView text) {
+        std::size_t lineBeginning = 0;
+        while (lineBeginning < text.size()) {
+            if (atLineStart_)
+                output_ += prefix_;
+            std::size_t lineEnd = text.find('\n', lineBeginning);
+            lineEnd = lineEnd == std::string::npos ? text.size() : lineEnd + 1;
+            output_ += text.substr(lineBeginning, lineEnd - lineBeginning);
+            atLineStart_ = text[lineEnd - 1] == '\n';
+            lineBeginning = lineEnd;
+        }
+    }
+
+    Output & output_;
+    /// Concatenated indents of the texts that are being written.
+    std::string prefix_;
+    bool atLineStart_ = false;
+};
+
+void Output::include(const ExpandedText & text, StringView indent)
+{
+    if (inclusions_ == nullptr) {
+        IndentedWriter(*this).write(text, indent);
+        return;
+    }
+    inclusions_->push_back(ExpandedText::Inclusion {
+        buffer_.size(), &text, std::string(indent)
+    });
+    size_ += text.indentedSize(indent.size());
+}
+
+/// @return Whole text.
+std::string toString(const ExpandedText & text)
+{
+    Output output;
+    output.include(text, StringView());
+    return std::move(output.text());
+}
+
+/// @brief Writes contents to file filename. In skipUnchanged mode, leaves
+/// the file untouched if it already has contents. Prints error message to
+/// errors in case of filesystem error.
+/// @return true if the file was left untouched.
+/// @throw Error In case of filesystem error.
+bool writeFile(const std::string & filename, StringView contents,
+               IncludeExpander::OutputMode outputMode, std::ostream & errors)
+{
+    OutputFile file(filename, outputMode);
+    file.write(contents);
+    return file.finish(errors);
+}
+
+/// @brief Appends path to depfile escaping characters that are special for
+/// Make and Ninja: ' ', '#' and ':' are preceded by '\\', '$' by '$'. Other
+/// backslashes are literal, except that backslashes before a space are
+/// doubled.
+void appendEscapedPath(std::string & depfile, const std::string & path)
+{
+    std::size_t backslashCount = 0;
+    for (char c : path) {
+        if (c == ' ')
+            depfile.append(backslashCount + 1, '\\');
+        else if (c == '#' || c == ':')
+            depfile += '\\';
+        else if (c == '$')
+            depfile += '$';
+        backslashCount = c == '\\' ? backslashCount + 1 : 0;
+        depfile += c;
+    }
+}
+
+/// @return Number of threads that should perform taskCount tasks:
+/// threadCount (0 means the number of hardware threads) limited by taskCount.
+unsigned actualThreadCount(unsigned threadCount, std::size_t taskCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    if (threadCount > taskCount)
+        threadCount = static_cast<unsigned>(taskCount);
+    return threadCount;
+}
+
 
 using namespace PatternUtilities;
 
 } // END unnamed namespace
 
 
+/// @brief Expanded modules, which are shared by Impl instances. Impl instances
+/// can work in different threads.
+class IncludeExpander::ModuleCache
+{
+public:
+    struct Module {
+        /// Own text is owned by the cache once the module is inserted.
+        /// Included texts belong to cached modules.
+        ExpandedText contents;
+        /// Sorted names of all modules that were included during expansion
+        /// of this module (directly or indirectly).
+        std::vector<std::string> dependencies;
+    };
+    /// (moduleName, module)
+    typedef std::pair<const std::string, Module> Entry;
+
+    /// @return Source of module texts.
+    const ModuleProvider & provider() const { return *provider_; }
+
+    /// @brief Switches to provider. Clears cache if provider differs from
+    /// the current one.
+    /// WARNING: must not be called while Impl instances are working.
+    void setProvider(const ModuleProvider & provider);
+
+    /// @brief Switches to FileModuleProvider for modulesDir that reads files
+    /// in readMode. Clears cache unless it is the current provider already.
+    /// WARNING: must not be called while Impl instances are working.
+    void setModulesDir(const std::string & modulesDir,
+                       CommonUtilities::MappedFile::Mode readMode);
+
+    /// @return Persistent cache; nullptr if it is disabled.
+    const DiskCache * diskCache() const { return diskCache_.get(); }
+
+    /// @brief Enables persistent cache in directory cacheDir or disables it
+    /// if cacheDir is empty.
+    /// WARNING: must not be called while Impl instances are working.
+    void setDiskCacheDir(const std::string & cacheDir);
+
+    /// @return Expanded moduleName; nullptr if moduleName is not cached.
+    const Entry * find(const std::string & moduleName) const;
+
+    /// @brief Caches expanded moduleName. Copies own text of module.contents
+    /// into the cache's storage.
+    /// @return Cached module, which remains valid until cache is cleared.
+    const Entry & insert(std::string moduleName, Module module);
+
+    /// @brief Removes moduleName and all modules that depend on it.
+    /// WARNING: must not be called while Impl instances are working.
+    void erase(const std::string & moduleName);
+
+    /// @brief Removes all modules.
+    /// WARNING: must not be called while Impl instances are working.
+    void clear();
+
+    /// @brief Claims expansion of moduleName for expander, so that other
+    /// expanders that need moduleName wait for the result instead of
+    /// expanding it again. Waits while another expander expands moduleName,
+    /// unless waiting would close a cycle of expanders that wait for each
+    /// other. Such a cycle means an include cycle, which expander detects
+    /// when it expands moduleName itself.
+    /// @param claimed Is set to true if expander must expand moduleName and
+    /// then call releaseExpansion(moduleName).
+    /// @return Cached moduleName; nullptr if expander must expand it.
+    const Entry * claimExpansion(const std::string & moduleName,
+                                 const void * expander, bool & claimed);
+
+    /// @brief Ends expansion of moduleName claimed by claimExpansion(),
+    /// whether it succeeded (moduleName was inserted) or failed.
+    void releaseExpansion(const std::string & moduleName);
+
+    /// @brief Calls releaseExpansion() on destruction if expansion was
+    /// claimed.
+    class ExpansionClaim
+    {
+    public:
+        /// @param moduleName Claimed module; nullptr if nothing was claimed.
+        explicit ExpansionClaim(ModuleCache & cache,
+                                const std::string * moduleName)
+            : cache_(cache), claimed_(moduleName != nullptr),
+              moduleName_(claimed_ ? *moduleName : std::string()) {}
+
+        NEITHER_COPYABLE_NOR_MOVABLE(ExpansionClaim)
+
+        ~ExpansionClaim() {
+            if (claimed_)
+                cache_.releaseExpansion(moduleName_);
+        }
+
+    private:
+        ModuleCache & cache_;
+        const bool claimed_;
+        /// A copy: the name passed to the constructor can change.
+        const std::string moduleName_;
+    };
+
+    /// @brief Remembers hash of the current text of moduleName.
+    void setTextHash(const std::string & moduleName, DiskCache::Hash hash);
+
+    /// @return true if texts of all modules in dependencies have the listed
+    /// hashes. Reads and hashes each module at most once.
+    bool isUpToDate(const DiskCache::Dependencies & dependencies);
+
+    /// @brief Appends (moduleName, hash of module's text) for each of
+    /// moduleNames to dependencies.
+    /// @return false if some module can not be read.
+    bool addTextHashes(const std::vector<std::string> & moduleNames,
+                       DiskCache::Dependencies & dependencies);
+
+private:
+    /// @return false if moduleName can not be read.
+    bool getTextHash(const std::string & moduleName, DiskCache::Hash & hash);
+
+    /// @return Slot of index_ that holds moduleName or the empty slot where
+    /// it belongs.
+    std::size_t findSlot(StringView moduleName) const;
+
+    /// @brief Adds entries_.back() to index_. Grows index_ if it is half full.
+    void indexLastEntry();
+
+    /// @return true if expander waiting for a module that holder expands
+    /// would close a cycle of waiting expanders.
+    bool waitingCloses(const void * holder, const void * expander) const;
+
+    const ModuleProvider * provider_ = nullptr;
+    /// Is used by setModulesDir().
+    std::unique_ptr<const FileModuleProvider> fileProvider_;
+    std::unique_ptr<const DiskCache> diskCache_;
+    /// Cached modules. A deque never moves its elements when growing, so
+    /// entries remain valid while other threads insert.
+    std::deque<Entry> entries_;
+    /// Open-addressing hash table of pointers to entries_; nullptr marks an
+    /// empty slot. Its size is 0 or a power of 2.
+    std::vector<const Entry *> index_;
+    /// Stores own texts of all modules in entries_.
+    CommonUtilities::TextArena contentsArena_;
+    /// Protects entries_, index_ and contentsArena_.
+    mutable std::mutex mutex_;
+
+    /// (moduleName, expander that claimed it)
+    std::map<std::string, const void *> expanding_;
+    /// (expander, name of the module it waits for)
+    std::map<const void *, std::string> waiting_;
+    /// Protects expanding_ and waiting_.
+    std::mutex expansionMutex_;
+    std::condition_variable expansionReleased_;
+
+    /// (moduleName, (is readable, hash of text))
+    std::map<std::string, std::pair<bool, DiskCache::Hash>> textHashes_;
+    /// Protects textHashes_.
+    std::mutex textHashesMutex_;
+};
+
+
+void IncludeExpander::ModuleCache::setProvider(
+    const ModuleProvider & provider)
+{
+    if (&provider != provider_) {
+        clear();
+        provider_ = &provider;
+    }
+}
+
+void IncludeExpander::ModuleCache::setModulesDir(
+    const std::string & modulesDir, CommonUtilities::MappedFile::Mode readMode)
+{
+    std::unique_ptr<const FileModuleProvider> provider(
+        new FileModuleProvider(modulesDir, readMode));
+    if (fileProvider_ == nullptr ||
+            provider->modulesDir() != fileProvider_->modulesDir() ||
+            provider->readMode() != fileProvider_->readMode()) {
+        fileProvider_ = std::move(provider);
+    }
+    setProvider(*fileProvider_);
+}
+
+void IncludeExpander::ModuleCache::setDiskCacheDir(
+    const std::string & cacheDir)
+{
+    if (cacheDir.empty())
+        diskCache_.reset();
+    else
+        diskCache_.reset(new DiskCache(cacheDir));
+}
+
+const IncludeExpander::ModuleCache::Entry *
+IncludeExpander::ModuleCache::find(const std::string & moduleName) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.empty() ? nullptr : index_[findSlot(moduleName)];
+}
+
+const IncludeExpander::ModuleCache::Entry &
+IncludeExpander::ModuleCache::insert(std::string moduleName, Module module)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (! index_.empty()) {
+        if (const Entry * const entry = index_[findSlot(moduleName)])
+            return *entry;
+    }
+    module.contents.ownText = contentsArena_.copy(module.contents.ownText);
+    entries_.emplace_back(std::move(moduleName), std::move(module));
+    indexLastEntry();
+    return entries_.back();
+}
+
+void IncludeExpander::ModuleCache::erase(const std::string & moduleName)
+{
+    // Remaining entries are moved to fresh storage, so that the memory of
+    // erased ones is reclaimed.
+    std::deque<Entry> entries;
+    entries.swap(entries_);
+    CommonUtilities::TextArena arena;
+    std::swap(arena, contentsArena_);
+    index_.clear();
+    // Modules are inserted after the modules they include, which remain if
+    // their includers remain. (old contents, new contents)
+    std::map<const ExpandedText *, const ExpandedText *> moved;
+    for (Entry & entry : entries) {
+        const std::vector<std::string> & dependencies =
+            entry.second.dependencies;
+        if (entry.first != moduleName &&
+                ! std::binary_search(dependencies.begin(), dependencies.end(),
+                                     moduleName)) {
+            for (auto & inclusion : entry.second.contents.inclusions)
+                inclusion.text = moved.at(inclusion.text);
+            moved[&entry.second.contents] =
+                &insert(entry.first, std::move(entry.second)).second.contents;
+        }
+    }
+    textHashes_.erase(moduleName);
+}
+
+void IncludeExpander::ModuleCache::clear()
+{
+    entries_.clear();
+    index_.clear();
+    contentsArena_.clear();
+    textHashes_.clear();
+}
+
+std::size_t IncludeExpander::ModuleCache::findSlot(
+    StringView moduleName) const
+{
+    const std::size_t mask = index_.size() - 1;
+    std::size_t slot =
+        static_cast<std::size_t>(CommonUtilities::Fnv1aHash::of(moduleName)) &
+        mask;
+    while (index_[slot] != nullptr && index_[slot]->first != moduleName)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+void IncludeExpander::ModuleCache::indexLastEntry()
+{
+    if (2 * entries_.size() > index_.size()) {
+        index_.assign(std::max<std::size_t>(2 * index_.size(), 64), nullptr);
+        for (const Entry & entry : entries_)
+            index_[findSlot(entry.first)] = &entry;
+    }
+    else
+        index_[findSlot(entries_.back().first)] = &entries_.back();
+}
+
+const IncludeExpander::ModuleCache::Entry *
+IncludeExpander::ModuleCache::claimExpansion(const std::string & moduleName,
+                                             const void * expander,
+                                             bool & claimed)
+{
+    claimed = false;
+    std::unique_lock<std::mutex> lock(expansionMutex_);
+    while (true) {
+        // The module could have been expanded while we were waiting.
+        if (const Entry * const entry = find(moduleName))
+            return entry;
+        const auto it = expanding_.find(moduleName);
+        if (it == expanding_.end()) {
+            expanding_.insert(std::make_pair(moduleName, expander));
+            claimed = true;
+            return nullptr;
+        }
+        if (it->second == expander || waitingCloses(it->second, expander))
+            return nullptr;
+        waiting_[expander] = moduleName;
+        expansionReleased_.wait(lock);
+        waiting_.erase(expander);
+    }
+}
+
+void IncludeExpander::ModuleCache::releaseExpansion(
+    const std::string & moduleName)
+{
+    {
+        std::lock_guard<std::mutex> lock(expansionMutex_);
+        expanding_.erase(moduleName);
+    }
+    expansionReleased_.notify_all();
+}
+
+bool IncludeExpander::ModuleCache::waitingCloses(const void * holder,
+                                                 const void * expander) const
+{
+    // Waiting expanders never form a cycle, so the chain ends.
+    while (true) {
+        const auto waiting = waiting_.find(holder);
+        if (waiting == waiting_.end())
+            return false;
+        const auto it = expanding_.find(waiting->second);
+        if (it == expanding_.end())
+            return false;
+        holder = it->second;
+        if (holder == expander)
+            return true;
+    }
+}
+
+void IncludeExpander::ModuleCache::setTextHash(const std::string & moduleName,
+                                               DiskCache::Hash hash)
+{
+    std::lock_guard<std::mutex> lock(textHashesMutex_);
+    textHashes_[moduleName] = { true, hash };
+}
+
+bool IncludeExpander::ModuleCache::isUpToDate(
+    const DiskCache::Dependencies & dependencies)
+{
+    for (const auto & dependency : dependencies) {
+        DiskCache::Hash hash;
+        if (! getTextHash(dependency.first, hash) || hash != dependency.second)
+            return false;
+    }
+    return true;
+}
+
+bool IncludeExpander::ModuleCache::addTextHashes(
+    const std::vector<std::string> & moduleNames,
+    DiskCache::Dependencies & dependencies)
+{
+    for (const std::string & name : moduleNames) {
+        DiskCache::Hash hash;
+        if (! getTextHash(name, hash))
+            return false;
+        dependencies.emplace_back(name, hash);
+    }
+    return true;
+}
+
+bool IncludeExpander::ModuleCache::getTextHash(const std::string & moduleName,
+                                               DiskCache::Hash & hash)
+{
+    std::lock_guard<std::mutex> lock(textHashesMutex_);
+    auto it = textHashes_.find(moduleName);
+    if (it == textHashes_.end()) {
+        const ModuleProvider::Text text = provider_->getText(moduleName);
+        it = textHashes_.insert(
+                 std::make_pair(moduleName, std::make_pair(
+                                    text.found,
+                                    CommonUtilities::Fnv1aHash::of(
+                                        text.text)))).first;
+    }
+    hash = it->second.second;
+    return it->second.first;
+}
+
+
+namespace
+{
+/// Patterns reference these instead of copying the constants. They are
+/// initialized at compile time.
+constexpr auto startCommandConstant = IncludeExpander::startCommand();
+constexpr auto startSeparatorConstant = IncludeExpander::startSeparator();
+constexpr auto libraryPrefixConstant = IncludeExpander::libraryPrefix();
+constexpr auto endSeparatorConstant = IncludeExpander::endSeparator();
+static_assert(endSeparatorConstant.size() == 1,
+              "searchEndSeparator_ searches for a single symbol.");
+
+} // END unnamed namespace
+
+
 class IncludeExpander::Impl
 {
 public:
-    explicit Impl();
+    explicit Impl(ModuleCache & cache) : cache_(cache) {}
+
+    /// @brief Expands inputFile into outputFile. Prints error messages to
+    /// errors.
+    /// @param inputMode Must be readIntoBuffer if inputFile can be written
+    /// to concurrently.
+    /// @param dependencies If not nullptr, receives modules included by
+    /// inputFile (nothing if expansion fails).
+    /// @return Exit code suitable to return from main().
+    int expandFile(const std::string & inputFile,
+                   const std::string & outputFile, std::ostream & errors,
+                   const OutputOptions & outputOptions,
+                   CommonUtilities::MappedFile::Mode inputMode =
+                       CommonUtilities::MappedFile::mapIfPossible,
+                   Dependencies * dependencies = nullptr);
+
+    /// @brief Expands source into output. Prints error messages to errors.
+    /// @param dependencies If not nullptr, receives modules included by
+    /// source.
+    /// @return false if expansion fails.
+    bool expandText(StringView source, Output & output, std::ostream & errors,
+                    Dependencies * dependencies = nullptr);
+
+    /// @return true if the last expandFile() call left outputFile untouched
+    /// because it already had the expanded contents.
+    bool outputUnchanged() const { return outputUnchanged_; }
+
+    /// @return Names of modules included by source in the order of includes
+    /// (possibly repeated).
+    std::vector<std::string> scanIncludes(StringView source);
+
+    /// @brief Enables or disables collection of statistics (disabled by
+    /// default).
+    void setCollectingStatistics(bool collecting) {
+        collectingStatistics_ = collecting;
+    }
+
+    /// @return Statistics collected since the previous call.
+    Statistics takeStatistics();
 
-    /// @brief Expands source and returns result.
-    /// @param modulesDir Directory that contains cmake modules.
-    std::string expand(const std::string & source, std::string modulesDir);
+    /// @brief Expands text of module moduleName and caches result. Included
+    /// modules are taken from cache_ if possible.
+    /// @throw Error In case of filesystem error or include cycle.
+    void preExpandModule(const std::string & moduleName, StringView text,
+                         std::ostream & errors);
 
 private:
-    /// @return Comment suitable for placing before included contents of module
-    /// moduleName.
-    std::string getIncludeOpeningComment(std::string moduleName);
-    /// @return Comment suitable for placing after included contents of module
-    /// moduleName.
-    std::string getIncludeClosingComment(std::string moduleName);
+    /// @return Make/Ninja depfile that states that outputFile depends on
+    /// inputFile and on files of modules in dependencies.
+    std::string makeDepfile(const std::string & outputFile,
+                            const std::string & inputFile,
+                            const Dependencies & dependencies) const;
+
+    /// @brief Expands source and appends result to output.
+    /// @throw Error In case of filesystem error or include cycle.
+    void expand(StringView source, Output & output);
+
+    /// @brief Appends to output comment suitable for placing before included
+    /// contents of module moduleName.
+    static void appendIncludeOpeningComment(Output & output,
+                                            const std::string & moduleName);
+    /// @brief Appends to output comment suitable for placing after included
+    /// contents of module moduleName.
+    static void appendIncludeClosingComment(Output & output,
+                                            const std::string & moduleName);
 
     /// @brief Reads module's text, expands all includes recursively and
-    /// returns result.
-    std::string getContents(const std::string & moduleName);
+    /// returns result. Takes result from cache_ if possible. Adds moduleName
+    /// and its dependencies to the innermost level of dependencyStack_.
+    /// @throw Error In case of filesystem error or include cycle.
+    const ExpandedText & getContents(const std::string & moduleName);
+
+    /// @brief Caches module moduleName if the provider has it expanded.
+    /// @return Cached module; nullptr if expanded module is not available.
+    const ModuleCache::Entry * loadExpanded(const std::string & moduleName);
+
+    /// @brief Expands text of module includeChain_.back() (or loads it from
+    /// the persistent cache), caches result and pops includeChain_.
+    /// @return Cached result.
+    /// @throw Error In case of filesystem error or include cycle.
+    const ModuleCache::Entry & expandModule(StringView text);
+
+    /// @brief Calls expander, which expands a source.
+    /// @return Sorted names of modules included during the call.
+    /// @throw Error In case of filesystem error or include cycle.
+    template <typename Expander>
+    Dependencies collectDependencies(Expander expander);
+
+    /// @return (<persistent cache entry>, true) if cache is enabled and entry
+    /// key is up to date; (DiskCache::Entry(), false) otherwise.
+    std::pair<DiskCache::Entry, bool> loadFromDiskCache(DiskCache::Hash key);
+
+    /// @brief Stores module to the persistent cache if it is enabled.
+    void storeToDiskCache(DiskCache::Hash key, const ExpandedText & contents,
+                          const Dependencies & dependencies);
+
+    /// @brief If moduleName is being expanded already, prints the include
+    /// cycle to *errors_ and throws.
+    /// @throw Error If moduleName is present in includeChain_.
+    void checkIncludeCycle(const std::string & moduleName) const;
+
+    /// @param splicedIncludeEndsLine If true, text that follows an expanded
+    /// include in the same line of source is treated as a new line. Thus
+    /// "include(vedgTools/A) include(vedgTools/B)" expands both modules.
+    /// @brief Expands includes in source and appends result to output.
+    void expandIncludes(StringView source, bool splicedIncludeEndsLine,
+                        Output & output);
+
+
+    /// @return &(statistics_.*seconds) if statistics are collected; nullptr
+    /// otherwise. Suitable for ScopedTimer.
+    double * timer(double Statistics::* seconds) {
+        return collectingStatistics_ ? &(statistics_.*seconds) : nullptr;
+    }
 
-    /// @return (<expanded source>, true) if include patterns are present in
-    /// source; (std::string(), false) otherwise.
-    std::pair<std::string, bool> expandIncludes(const std::string & source);
+    /// @brief Counts match() calls of patterns during a match() call of
+    /// matcher that started from the first pattern.
+    template <class Matcher>
+    void countMatchAttempts(
+        std::array<std::size_t, Matcher::size()> & attempts,
+        const Matcher & matcher, bool matched) {
+        if (! collectingStatistics_)
+            return;
+        const std::size_t end =
+            matched ? attempts.size() :
+            std::min(matcher.currentPatternIndex() + 1, attempts.size());
+        for (std::size_t i = 0; i < end; ++i)
+            ++attempts[i];
+    }
 
+    /// @brief Counts file that was written unless it was left unchanged.
+    void countWrittenFile(bool unchanged, std::size_t size) {
+        if (collectingStatistics_ && ! unchanged) {
+            ++statistics_.filesWritten;
+            statistics_.bytesWritten += size;
+        }
+    }
+
+
+    /// Discarders are template arguments of patterns, so they are inlined.
+    typedef StaticString<SkipWs> WsString;
+    typedef StaticString<SkipBlank> BlankString;
+    typedef StaticCiString<SkipWs> WsCiString;
 
     Whitespace whitespace_;
 
-    SearchCiStringLine startInclude_ { startCommand() };
-    String startSeparator_ { startSeparator(), Str::skipWs };
-    String libraryPrefix_ { libraryPrefix(), Str::skipWs };
-    Param filename_ { Str::noSkip };
-    String endSeparator_ { endSeparator(), Str::skipWs };
+    SearchKeywordLine startInclude_ {
+        startCommandConstant, SearchKeywordLine::caseInsensitive
+    };
+    WsString startSeparator_ { startSeparatorConstant };
+    WsString libraryPrefix_ { libraryPrefixConstant };
+    BasicParam<NoSkip> filename_;
+    WsString endSeparator_ { endSeparatorConstant };
 
 
-    SearchStringLine startBoilerplate_ { "##" };
-    std::array<String, 3> directiveBoilerplate_ {{
-            String("vedgTools/CMakeModules", Str::skipBlank),
-            String("path", Str::skipBlank),
-            String("boilerplate", Str::skipBlank)
+    SearchKeywordLine startBoilerplate_ { "##" };
+    std::array<BlankString, 3> directiveBoilerplate_ {{
+            BlankString("vedgTools/CMakeModules"),
+            BlankString("path"),
+            BlankString("boilerplate")
         }
     };
     SearchSymbol searchEndOfLine_ { '\n' };
 
-    CiString includeCommand_ { startCommand(), Str::skipWs };
-    std::array<String, 2> includeBoilerplate_ {{
-            String("OPTIONAL", Str::skipWs),
-            String("RESULT_VARIABLE", Str::skipWs)
+    WsCiString includeCommand_ { startCommandConstant };
+    std::array<WsString, 2> includeBoilerplate_ {{
+            WsString("OPTIONAL"),
+            WsString("RESULT_VARIABLE")
         }
     };
-    Param wasIncluded_ { Str::skipWs };
+    BasicParam<SkipWs> wasIncluded_;
 
-    CiString if_ { "if", Str::skipWs };
-    ParamCopy wasIncludedCopy_ { wasIncluded_, Str::skipWs };
-    std::array<String, 2> ifVars {{
-            String("STREQUAL", Str::skipWs), String("NOTFOUND", Str::skipWs)
+    WsCiString if_ { "if" };
+    BasicParamCopy<SkipWs> wasIncludedCopy_ { wasIncluded_ };
+    std::array<WsString, 2> ifVars {{
+            WsString("STREQUAL"), WsString("NOTFOUND")
         }
     };
 
-    SearchCiStringLine endif_ { "endif" };
-    SearchSymbol searchEndSeparator_ { endSeparator().back() };
+    SearchKeywordLine endif_ { "endif", SearchKeywordLine::caseInsensitive };
+    SearchSymbol searchEndSeparator_ { endSeparatorConstant.back() };
 
 
-    const PatternMatcher::PatternSequence includeSequence_;
-    /// NOTE: non-const only because of verbose initialization in constructor.
-    /// May not be changed after constructor.
-    PatternMatcher::PatternSequence boilerplateSequence_;
+    typedef StaticPatternMatcher<
+        SearchKeywordLine, WsString, WsString, BasicParam<NoSkip>,
+        WsString> IncludeMatcher;
+    IncludeMatcher makeIncludeMatcher() {
+        return IncludeMatcher(startInclude_, startSeparator_, libraryPrefix_,
+                              filename_, endSeparator_);
+    }
+
+    static const char * const includePatternNames_[];
+
+    typedef StaticPatternMatcher<
+        SearchKeywordLine, std::array<BlankString, 3>, SearchSymbol,
+        WsCiString, WsString, WsString, BasicParam<NoSkip>,
+        std::array<WsString, 2>, BasicParam<SkipWs>, WsString,
+        WsCiString, WsString, BasicParamCopy<SkipWs>,
+        std::array<WsString, 2>, WsString,
+        SearchKeywordLine, SearchSymbol> BoilerplateMatcher;
+    BoilerplateMatcher makeBoilerplateMatcher() {
+        return BoilerplateMatcher(
+                   startBoilerplate_, directiveBoilerplate_, searchEndOfLine_,
+                   includeCommand_, startSeparator_, libraryPrefix_, filename_,
+                   includeBoilerplate_, wasIncluded_, endSeparator_,
+                   if_, startSeparator_, wasIncludedCopy_, ifVars,
+                   endSeparator_,
+                   endif_, searchEndSeparator_);
+    }
+
+    static const char * const boilerplatePatternNames_[];
+
+    ModuleCache & cache_;
+    /// Error messages of current expandFile() call are printed here.
+    std::ostream * errors_ = &std::cerr;
+    /// Names of modules that are being expanded at the moment. The last one
+    /// is the innermost.
+    std::vector<std::string> includeChain_;
+    /// Names of modules included by sources that are being expanded at the
+    /// moment. Level dependencyDepth_ - 1 corresponds to the innermost source.
+    /// Names are owned by cache_, and levels are kept between expansions, so
+    /// collecting names rarely allocates.
+    std::vector<std::vector<const std::string *>> dependencyStack_;
+    std::size_t dependencyDepth_ = 0;
+    /// Indent of expanded lines; is kept to reuse its memory.
+    std::string biggerIndent_;
+    bool outputUnchanged_ = false;
+
+    bool collectingStatistics_ = false;
+    Statistics statistics_;
+    std::array<std::size_t, IncludeMatcher::size()> includePatternAttempts_ {{}};
+    std::array<std::size_t, BoilerplateMatcher::size()>
+    boilerplatePatternAttempts_ {{}};
+};
 
-    /// Holds current modulesDir.
-    std::string modulesDir_;
 
-    /// (moduleName, moduleContents)
-    std::map<std::string, std::string> modules_;
+const char * const IncludeExpander::Impl::includePatternNames_[] = {
+    "SearchKeywordLine", "StaticString<SkipWs>", "StaticString<SkipWs>",
+    "BasicParam<NoSkip>", "StaticString<SkipWs>"
 };
 
+const char * const IncludeExpander::Impl::boilerplatePatternNames_[] = {
+    "SearchKeywordLine", "StaticString<SkipBlank>", "StaticString<SkipBlank>",
+    "StaticString<SkipBlank>", "SearchSymbol",
+    "StaticCiString<SkipWs>", "StaticString<SkipWs>", "StaticString<SkipWs>",
+    "BasicParam<NoSkip>", "StaticString<SkipWs>", "StaticString<SkipWs>",
+    "BasicParam<SkipWs>", "StaticString<SkipWs>",
+    "StaticCiString<SkipWs>", "StaticString<SkipWs>",
+    "BasicParamCopy<SkipWs>", "StaticString<SkipWs>", "StaticString<SkipWs>",
+    "StaticString<SkipWs>",
+    "SearchKeywordLine", "SearchSymbol"
+};
 
-IncludeExpander::Impl::Impl()
-    : includeSequence_ {
-    & startInclude_, & startSeparator_,
-    & libraryPrefix_, & filename_, & endSeparator_
-}, boilerplateSequence_(1, & startBoilerplate_)
+Statistics IncludeExpander::Impl::takeStatistics()
 {
-    for (auto & p : directiveBoilerplate_)
-        boilerplateSequence_.push_back(& p);
-    boilerplateSequence_.push_back(& searchEndOfLine_);
+    static_assert(sizeof(includePatternNames_) / sizeof(const char *) ==
+                  IncludeMatcher::size(), "Wrong number of pattern names.");
+    static_assert(sizeof(boilerplatePatternNames_) / sizeof(const char *) ==
+                  BoilerplateMatcher::size(), "Wrong number of pattern names.");
+    Statistics result;
+    std::swap(result, statistics_);
+    for (std::size_t i = 0; i < includePatternAttempts_.size(); ++i) {
+        if (includePatternAttempts_[i] != 0) {
+            result.patternMatchAttempts[includePatternNames_[i]] +=
+                includePatternAttempts_[i];
+            includePatternAttempts_[i] = 0;
+        }
+    }
+    for (std::size_t i = 0; i < boilerplatePatternAttempts_.size(); ++i) {
+        if (boilerplatePatternAttempts_[i] != 0) {
+            result.patternMatchAttempts[boilerplatePatternNames_[i]] +=
+                boilerplatePatternAttempts_[i];
+            boilerplatePatternAttempts_[i] = 0;
+        }
+    }
+    return result;
+}
+
+
+int IncludeExpander::Impl::expandFile(
+    const std::string & inputFile, const std::string & outputFile,
+    std::ostream & errors, const OutputOptions & outputOptions,
+    CommonUtilities::MappedFile::Mode inputMode, Dependencies * dependencies)
+{
+    errors_ = &errors;
+    outputUnchanged_ = false;
+    ScopedTimer readTimer(timer(&Statistics::readSeconds));
+    const CommonUtilities::MappedFile input(inputFile, inputMode);
+    readTimer.stop();
+    try {
+        checkError(input, inputFile, errors);
+    }
+    catch (const Error &) {
+        return 3;
+    }
+    if (collectingStatistics_) {
+        ++statistics_.filesRead;
+        statistics_.bytesRead += input.view().size();
+    }
 
-    boilerplateSequence_.push_back(& includeCommand_);
-    boilerplateSequence_.push_back(& startSeparator_);
-    boilerplateSequence_.push_back(& libraryPrefix_);
-    boilerplateSequence_.push_back(& filename_);
-    for (auto & p : includeBoilerplate_)
-        boilerplateSequence_.push_back(& p);
-    boilerplateSequence_.push_back(& wasIncluded_);
-    boilerplateSequence_.push_back(& endSeparator_);
+    ScopedTimer expandTimer(timer(&Statistics::expandSeconds));
+    Dependencies fileDependencies;
+    std::size_t outputSize;
+    try {
+        if (cache_.diskCache() == nullptr) {
+            // Without the persistent cache, the expanded text is not needed
+            // as a whole, so it is written while being expanded.
+            OutputFile file(outputFile, outputOptions.mode);
+            Output output(&file);
+            if (! expandText(input.view(), output, errors, &fileDependencies))
+                return 4;
+            output.flush();
+            expandTimer.stop();
+            ScopedTimer writeTimer(timer(&Statistics::writeSeconds));
+            outputUnchanged_ = file.finish(errors);
+            outputSize = output.size();
+        }
+        else {
+            const DiskCache::Hash key =
+                DiskCache::key("output", StringView(), input.view());
+            auto cached = loadFromDiskCache(key);
+            Output output;
+            StringView contents;
+            if (cached.second) {
+                contents = cached.first.contents;
+                for (auto & dependency : cached.first.dependencies) {
+                    fileDependencies.push_back(
+                        std::move(dependency.first));
+                }
+                if (collectingStatistics_)
+                    ++statistics_.filesExpanded;
+            }
+            else {
+                if (! expandText(input.view(), output, errors,
+                                 &fileDependencies)) {
+                    return 4;
+                }
+                contents = output.text();
+                storeToDiskCache(key, makeExpandedText(contents),
+                                 fileDependencies);
+            }
+            expandTimer.stop();
+            ScopedTimer writeTimer(timer(&Statistics::writeSeconds));
+            outputUnchanged_ = writeFile(outputFile, contents,
+                                         outputOptions.mode, errors);
+            outputSize = contents.size();
+        }
+        countWrittenFile(outputUnchanged_, outputSize);
+
+        if (! outputOptions.depfileExtension.empty() && outputFile != "-") {
+            ScopedTimer writeTimer(timer(&Statistics::writeSeconds));
+            const std::string depfile =
+                makeDepfile(outputFile, inputFile, fileDependencies);
+            countWrittenFile(
+                writeFile(outputFile + outputOptions.depfileExtension,
+                          depfile, outputOptions.mode, errors),
+                depfile.size());
+        }
+    }
+    catch (const Error &) {
+        return 5;
+    }
+    if (dependencies != nullptr)
+        *dependencies = std::move(fileDependencies);
+    return 0;
+}
 
-    boilerplateSequence_.push_back(& if_);
-    boilerplateSequence_.push_back(& startSeparator_);
-    boilerplateSequence_.push_back(& wasIncludedCopy_);
-    for (auto & p : ifVars)
-        boilerplateSequence_.push_back(& p);
-    boilerplateSequence_.push_back(& endSeparator_);
+bool IncludeExpander::Impl::expandText(
+    StringView source, Output & output, std::ostream & errors,
+    Dependencies * dependencies)
+{
+    errors_ = &errors;
+    dependencyDepth_ = 0;
+    try {
+        Dependencies sourceDependencies =
+        collectDependencies([&] { expand(source, output); });
+        if (dependencies != nullptr)
+            *dependencies = std::move(sourceDependencies);
+    }
+    catch (const Error &) {
+        return false;
+    }
+    if (collectingStatistics_)
+        ++statistics_.filesExpanded;
+    return true;
+}
 
-    boilerplateSequence_.push_back(& endif_);
-    boilerplateSequence_.push_back(& searchEndSeparator_);
+std::string IncludeExpander::Impl::makeDepfile(
+    const std::string & outputFile, const std::string & inputFile,
+    const Dependencies & dependencies) const
+{
+    std::string result;
+    appendEscapedPath(result, outputFile);
+    result += ':';
+    result += ' ';
+    appendEscapedPath(result, inputFile);
+    for (const std::string & moduleName : dependencies) {
+        const std::string filename = cache_.provider().filename(moduleName);
+        if (! filename.empty()) {
+            result += " \\\n  ";
+            appendEscapedPath(result, filename);
+        }
+    }
+    result += '\n';
+    return result;
 }
 
-std::string IncludeExpander::Impl::expand(
-    const std::string & source, std::string modulesDir)
+void IncludeExpander::Impl::expand(StringView source, Output & output)
 {
-    modulesDir_ = std::move(modulesDir);
+    includeChain_.clear();
 
-    PatternMatcher boilerplateMatcher(boilerplateSequence_);
+    BoilerplateMatcher boilerplateMatcher = makeBoilerplateMatcher();
     std::size_t index = 0;
     bool matchedDirective, matched;
 
     while (true) {
         matched = boilerplateMatcher.match(source, index);
+        countMatchAttempts(boilerplatePatternAttempts_, boilerplateMatcher,
+                           matched);
         matchedDirective = boilerplateMatcher.currentPatternIndex() >
                            directiveBoilerplate_.size();
         if (matched || matchedDirective ||
@@ -216,13 +1331,15 @@ std::string IncludeExpander::Impl::expand(
         const std::size_t posAfterComment =
             eofFound ?
             searchEndOfLine_.getSymbolPosition() + 1 : source.size();
-        std::string result = source.substr(0, posAfterComment);
+        // Includes are expanded in source with the boilerplate replaced, so
+        // this (usually short) modified source is built in memory.
+        std::string result(source.substr(0, posAfterComment));
         if (matched) {
             result +=
                 "## Boilerplate code that searches CMakeModules in "
-                "${CMAKE_MODULE_PATH} and adds it if missing was omitted.\n" +
-                getContents(filename_.getParam()) +
-                source.substr(index);
+                "${CMAKE_MODULE_PATH} and adds it if missing was omitted.\n";
+            result += toString(getContents(filename_.getParam()));
+            result += source.substr(index);
         }
         else {
             if (! eofFound)
@@ -230,100 +1347,290 @@ std::string IncludeExpander::Impl::expand(
             result +=
                 "## WARNING: boilerplate directive was detected, but "
                 "following lines don't match prefedined patterns.\n"
-                "## Boilerplate substitution was not executed.\n" +
-                source.substr(posAfterComment);
+                "## Boilerplate substitution was not executed.\n";
+            result += source.substr(posAfterComment);
         }
-        auto expanded = expandIncludes(result);
-        if (expanded.second)
-            return std::move(expanded.first);
-        return result;
-    }
-    else {
-        auto expanded = expandIncludes(source);
-        if (expanded.second)
-            return std::move(expanded.first);
-        return source;
+        expandIncludes(result, false, output);
     }
+    else
+        expandIncludes(source, false, output);
 }
 
 
-std::string IncludeExpander::Impl::getIncludeOpeningComment(
-    std::string moduleName)
+void IncludeExpander::Impl::appendIncludeOpeningComment(
+    Output & output, const std::string & moduleName)
 {
-    return "# {!!! " + std::move(moduleName) + '\n';
+    output += "# {!!! ";
+    output += moduleName;
+    output += '\n';
 }
 
-std::string IncludeExpander::Impl::getIncludeClosingComment(
-    std::string moduleName)
+void IncludeExpander::Impl::appendIncludeClosingComment(
+    Output & output, const std::string & moduleName)
 {
-    return "# !!!} " + std::move(moduleName) + '\n';
+    output += "# !!!} ";
+    output += moduleName;
+    output += '\n';
 }
 
-std::string IncludeExpander::Impl::getContents(const std::string & moduleName)
+const ExpandedText & IncludeExpander::Impl::getContents(
+    const std::string & moduleName)
 {
 # ifdef DEBUG_INCLUDE_EXPANDER
     std::cout << "Getting contents of " << moduleName << std::endl;
 # endif
-    auto p = modules_.equal_range(moduleName);
-    if (p.first == p.second) {
-        std::string contents = getText(modulesDir_, moduleName + ".cmake");
-        p.first = modules_.
-# if GCC_EARLIER_THAN_4_8
-                  insert(p.first,
-                         std::make_pair(moduleName, std::move(contents)));
-# else
-                  emplace_hint(p.first, moduleName, std::move(contents));
+    bool cacheMissed = false;
+    const ModuleCache::Entry * entry = cache_.find(moduleName);
+    if (entry == nullptr) {
+        // Only expanders that need the same module wait for each other.
+        bool claimed;
+        entry = cache_.claimExpansion(moduleName, this, claimed);
+        const ModuleCache::ExpansionClaim claim(
+            cache_, claimed ? &moduleName : nullptr);
+        if (entry == nullptr) {
+            cacheMissed = true;
+            entry = loadExpanded(moduleName);
+        }
+        if (entry == nullptr) {
+            checkIncludeCycle(moduleName);
+            includeChain_.push_back(moduleName);
+            if (collectingStatistics_) {
+                statistics_.maxIncludeDepth = std::max(
+                                                  statistics_.maxIncludeDepth,
+                                                  includeChain_.size());
+            }
+
+            const ModuleProvider & provider = cache_.provider();
+# ifdef DEBUG_INCLUDE_EXPANDER
+            std::cout << "Getting text of " << provider.filename(moduleName)
+                      << std::endl;
 # endif
-        while (true) {
-            auto expanded = expandIncludes(p.first->second);
-            if (expanded.second)
-                p.first->second = std::move(expanded.first);
-            else
-                break;
+            ScopedTimer readTimer(timer(&Statistics::readSeconds));
+            const ModuleProvider::Text text = provider.getText(moduleName);
+            readTimer.stop();
+            checkError(text, provider, moduleName, *errors_);
+            if (collectingStatistics_) {
+                ++statistics_.filesRead;
+                statistics_.bytesRead += text.text.size();
+            }
+            // WARNING: expandModule() can modify filename_, so moduleName
+            // (which may refer to filename_.getParam()) must not be used
+            // below.
+            entry = &expandModule(text.text);
         }
     }
-    return p.first->second;
+    if (collectingStatistics_) {
+        ++(cacheMissed ? statistics_.moduleCacheMisses :
+           statistics_.moduleCacheHits);
+    }
+    if (dependencyDepth_ != 0) {
+        std::vector<const std::string *> & dependencies =
+            dependencyStack_[dependencyDepth_ - 1];
+        const std::size_t size =
+            dependencies.size() + 1 + entry->second.dependencies.size();
+        if (size > dependencies.capacity())
+            dependencies.reserve(std::max(size, 2 * dependencies.capacity()));
+        dependencies.push_back(&entry->first);
+        for (const std::string & dependency : entry->second.dependencies)
+            dependencies.push_back(&dependency);
+    }
+    return entry->second.contents;
 }
 
-std::pair<std::string, bool> IncludeExpander::Impl::expandIncludes(
-    const std::string & source)
+const IncludeExpander::ModuleCache::Entry *
+IncludeExpander::Impl::loadExpanded(const std::string & moduleName)
 {
-    std::string result;
-    bool expanded = false;
-    PatternMatcher includeMatcher(includeSequence_);
+    ModuleProvider::Text contents;
+    ModuleCache::Module module;
+    if (! cache_.provider().getExpanded(moduleName, contents,
+                                        module.dependencies)) {
+        return nullptr;
+    }
+    module.contents = makeExpandedText(contents.text);
+    return &cache_.insert(moduleName, std::move(module));
+}
+
+const IncludeExpander::ModuleCache::Entry &
+IncludeExpander::Impl::expandModule(StringView text)
+{
+    if (cache_.diskCache() != nullptr) {
+        cache_.setTextHash(includeChain_.back(),
+                           CommonUtilities::Fnv1aHash::of(text));
+    }
+    const DiskCache::Hash key =
+        DiskCache::key("module", includeChain_.back(), text);
+    ModuleCache::Module module;
+    auto cached = loadFromDiskCache(key);
+    std::vector<ExpandedText::Inclusion> inclusions;
+    Output output(inclusions);
+    if (cached.second) {
+        module.contents = makeExpandedText(cached.first.contents);
+        for (auto & dependency : cached.first.dependencies)
+            module.dependencies.push_back(std::move(dependency.first));
+    }
+    else {
+        // Nested modules are expanded depth-first, so contents is final after
+        // a single pass. Module is cached only when it is fully expanded.
+        // Included modules are referred to rather than copied, so own text
+        // is rarely longer than text.
+        output.text().reserve(text.size());
+        module.dependencies = collectDependencies(
+        [&] { expandIncludes(text, true, output); });
+        module.contents =
+            makeExpandedText(output.text(), std::move(inclusions));
+        storeToDiskCache(key, module.contents, module.dependencies);
+    }
+    std::string name = std::move(includeChain_.back());
+    includeChain_.pop_back();
+    // output owns own text of module.contents until the cache copies it.
+    return cache_.insert(std::move(name), std::move(module));
+}
+
+template <typename Expander>
+IncludeExpander::Dependencies
+IncludeExpander::Impl::collectDependencies(Expander expander)
+{
+    if (dependencyStack_.size() == dependencyDepth_)
+        dependencyStack_.emplace_back();
+    dependencyStack_[dependencyDepth_++].clear();
+    expander();
+    // Nested calls could have reallocated dependencyStack_.
+    std::vector<const std::string *> & dependencies =
+        dependencyStack_[dependencyDepth_ - 1];
+    std::sort(dependencies.begin(), dependencies.end(),
+    [](const std::string * lhs, const std::string * rhs) {
+        return *lhs < *rhs;
+    });
+    Dependencies result;
+    result.reserve(dependencies.size());
+    for (const std::string * dependency : dependencies) {
+        if (result.empty() || result.back() != *dependency)
+            result.push_back(*dependency);
+    }
+    --dependencyDepth_;
+    return result;
+}
+
+std::pair<DiskCache::Entry, bool> IncludeExpander::Impl::loadFromDiskCache(
+    DiskCache::Hash key)
+{
+    std::pair<DiskCache::Entry, bool> result;
+    const DiskCache * const diskCache = cache_.diskCache();
+    result.second = diskCache != nullptr &&
+                    diskCache->load(key, result.first) &&
+                    cache_.isUpToDate(result.first.dependencies);
+    if (collectingStatistics_ && diskCache != nullptr) {
+        ++(result.second ? statistics_.diskCacheHits :
+           statistics_.diskCacheMisses);
+    }
+    return result;
+}
+
+void IncludeExpander::Impl::storeToDiskCache(
+    DiskCache::Hash key, const ExpandedText & contents,
+    const Dependencies & dependencies)
+{
+    const DiskCache * const diskCache = cache_.diskCache();
+    if (diskCache == nullptr)
+        return;
+    DiskCache::Entry entry;
+    if (cache_.addTextHashes(dependencies, entry.dependencies)) {
+        entry.contents = toString(contents);
+        diskCache->store(key, entry);
+    }
+}
+
+std::vector<std::string> IncludeExpander::Impl::scanIncludes(
+    StringView source)
+{
+    std::vector<std::string> result;
+    IncludeMatcher includeMatcher = makeIncludeMatcher();
+    // Modules are scanned with the same line boundaries as expandIncludes()
+    // uses for them.
+    std::size_t index = 0, prevIndex = 0;
+    while (true) {
+        startInclude_.setLineBoundary(prevIndex);
+        const bool matched = includeMatcher.match(source, index);
+        countMatchAttempts(includePatternAttempts_, includeMatcher, matched);
+        if (matched) {
+            result.push_back(filename_.getParam());
+            prevIndex = index;
+        }
+        else if (includeMatcher.currentPatternIndex() == 0)
+            break;
+        includeMatcher.reset();
+    }
+    return result;
+}
+
+void IncludeExpander::Impl::preExpandModule(const std::string & moduleName,
+                                            StringView text,
+                                            std::ostream & errors)
+{
+    errors_ = &errors;
+    dependencyDepth_ = 0;
+    includeChain_.assign(1, moduleName);
+    if (collectingStatistics_) {
+        statistics_.maxIncludeDepth =
+            std::max<std::size_t>(statistics_.maxIncludeDepth, 1);
+    }
+    expandModule(text);
+}
+
+void IncludeExpander::Impl::checkIncludeCycle(
+    const std::string & moduleName) const
+{
+    const auto it = std::find(includeChain_.begin(), includeChain_.end(),
+                              moduleName);
+    if (it == includeChain_.end())
+        return;
+    *errors_ << "Include cycle detected: ";
+    for (auto i = it; i != includeChain_.end(); ++i)
+        *errors_ << *i << " -> ";
+    *errors_ << moduleName << '.' << std::endl;
+    throw Error();
+}
+
+void IncludeExpander::Impl::expandIncludes(
+    StringView source, bool splicedIncludeEndsLine, Output & output)
+{
+    IncludeMatcher includeMatcher = makeIncludeMatcher();
 
     std::size_t index = 0, prevIndex = 0;
     while (true) {
-        if (includeMatcher.match(source, index)) {
-            expanded = true;
+        startInclude_.setLineBoundary(splicedIncludeEndsLine ? prevIndex : 0);
+        const bool matched = includeMatcher.match(source, index);
+        countMatchAttempts(includePatternAttempts_, includeMatcher, matched);
+        if (matched) {
             const std::size_t lineBeginning = startInclude_.getLineBeginning();
-            result += source.substr(prevIndex, lineBeginning - prevIndex);
+            output += source.substr(prevIndex, lineBeginning - prevIndex);
 
-            std::string indent =
+            const StringView indent =
                 source.substr(
                     lineBeginning,
                     startInclude_.getPatternBeginning() - lineBeginning);
-            // Use indent of include-line + 2 spaces for all expanded lines.
-            const std::string biggerIndent = indent + "  ";
 
-            std::string moduleName = filename_.getParam();
-            result += indent + getIncludeOpeningComment(moduleName);
+            const std::string moduleName = filename_.getParam();
+            output += indent;
+            appendIncludeOpeningComment(output, moduleName);
 
-            std::size_t indentPos = result.size();
             /// WARNING: be careful with reordering statements because
-            /// getContents() can modify startInclude_, filename_.
-            result += getContents(moduleName);
-            while (true) {
-                result.insert(indentPos, biggerIndent);
-                indentPos = result.find('\n', indentPos);
-                if (indentPos == std::string::npos)
-                    break;
-                if (++indentPos == result.size())
-                    break;
+            /// getContents() can modify startInclude_, filename_ and
+            /// biggerIndent_.
+            const ExpandedText & contents = getContents(moduleName);
+            // Use indent of include-line + 2 spaces for all expanded lines.
+            biggerIndent_.assign(indent.data(), indent.size());
+            biggerIndent_ += "  ";
+            const std::size_t sizeBefore = output.size();
+            output.include(contents, biggerIndent_);
+            if (collectingStatistics_) {
+                ++statistics_.includesExpanded;
+                statistics_.indentationBytes +=
+                    output.size() - sizeBefore - contents.size;
             }
 
-            result += std::move(indent) +
-                      getIncludeClosingComment(std::move(moduleName));
+            output += indent;
+            appendIncludeClosingComment(output, moduleName);
 
             prevIndex = index;
         }
@@ -331,50 +1638,345 @@ std::pair<std::string, bool> IncludeExpander::Impl::expandIncludes(
             break;
         includeMatcher.reset();
     }
-    if (expanded)
-        result += source.substr(prevIndex);
-
-    return { std::move(result), expanded };
+    output += source.substr(prevIndex);
 }
 
 
-IncludeExpander::IncludeExpander() : impl_(new Impl)
+IncludeExpander::IncludeExpander()
+    : cache_(new ModuleCache), impl_(new Impl(*cache_))
 {}
 
 IncludeExpander::~IncludeExpander() noexcept = default;
 
+template <class Work>
+void IncludeExpander::runInThreads(unsigned threadCount, Work work)
+{
+    std::vector<Statistics> workerStatistics(threadCount);
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threadCount; ++t) {
+        workers.emplace_back([&, t] {
+            Impl impl(*cache_);
+            impl.setCollectingStatistics(statistics_ != nullptr);
+            work(impl);
+            workerStatistics[t] = impl.takeStatistics();
+        });
+    }
+    work(*impl_);
+    for (std::thread & worker : workers)
+        worker.join();
+    if (statistics_ != nullptr) {
+        for (const Statistics & statistics : workerStatistics)
+            *statistics_ += statistics;
+    }
+}
+
+void IncludeExpander::collectStatistics()
+{
+    if (statistics_ != nullptr)
+        *statistics_ += impl_->takeStatistics();
+}
+
 int IncludeExpander::operator()(const std::string & inputFile,
                                 const std::string & outputFile,
                                 const std::string & modulesDir)
 {
-    std::ifstream input(inputFile);
-    const std::string source = CommonUtilities::getFileContents(input);
-    try {
-        checkError(input, inputFile);
+    cache_->setModulesDir(modulesDir, readMode_);
+    const int result = impl_->expandFile(inputFile, outputFile, std::cerr,
+                                         outputOptions_, readMode_);
+    if (impl_->outputUnchanged())
+        ++unchangedOutputCount_;
+    collectStatistics();
+    return result;
+}
+
+bool IncludeExpander::expand(StringView input, const ModuleProvider & provider,
+                             std::string & output, std::ostream & errors)
+{
+    cache_->setProvider(provider);
+    ScopedTimer expandTimer(statistics_ == nullptr ? nullptr :
+                            &statistics_->expandSeconds);
+    Output result;
+    const bool fine = impl_->expandText(input, result, errors);
+    expandTimer.stop();
+    if (fine)
+        output = std::move(result.text());
+    collectStatistics();
+    return fine;
+}
+
+bool IncludeExpander::expand(StringView input, const ModuleProvider & provider,
+                             std::ostream & output, std::ostream & errors)
+{
+    cache_->setProvider(provider);
+    ScopedTimer expandTimer(statistics_ == nullptr ? nullptr :
+                            &statistics_->expandSeconds);
+    StreamSink sink(output);
+    Output result(&sink);
+    bool fine = impl_->expandText(input, result, errors);
+    if (fine) {
+        result.flush();
+        if (! output.flush()) {
+            errors << "Writing expanded text failed." << std::endl;
+            fine = false;
+        }
     }
-    catch (const Error &) {
-        return 3;
+    expandTimer.stop();
+    collectStatistics();
+    return fine;
+}
+
+void IncludeExpander::setCollectingStatistics(bool collecting)
+{
+    if (collecting != (statistics_ != nullptr)) {
+        impl_->takeStatistics();
+        impl_->setCollectingStatistics(collecting);
+        statistics_.reset(collecting ? new Statistics : nullptr);
     }
+}
 
-    std::string result;
-    try {
-        std::string dir = modulesDir;
-        if (! dir.empty() && dir.back() != '/')
-            dir += '/';
-        result = impl_->expand(source, std::move(dir));
+void IncludeExpander::setCacheDir(const std::string & cacheDir)
+{
+    cache_->setDiskCacheDir(cacheDir);
+}
+
+void IncludeExpander::invalidateModule(const std::string & moduleName)
+{
+    cache_->erase(moduleName);
+}
+
+void IncludeExpander::clearCache()
+{
+    cache_->clear();
+}
+
+void IncludeExpander::preExpandModules(const std::string & modulesDir,
+                                       unsigned threadCount)
+{
+    cache_->setModulesDir(modulesDir, readMode_);
+    preExpandAllModules(threadCount);
+}
+
+void IncludeExpander::preExpandModules(const ModuleProvider & provider,
+                                       unsigned threadCount)
+{
+    cache_->setProvider(provider);
+    preExpandAllModules(threadCount);
+}
+
+void IncludeExpander::preExpandAllModules(unsigned threadCount)
+{
+    const ModuleProvider & provider = cache_->provider();
+
+    struct Module {
+        std::string name;
+        ModuleProvider::Text text;
+        /// Number of included modules that are not expanded yet.
+        std::size_t pendingIncludes;
+        /// Indices of modules that include this one.
+        std::vector<std::size_t> includers;
+    };
+    std::vector<Module> modules;
+    for (std::string & name : provider.moduleNames()) {
+        if (cache_->find(name) != nullptr)
+            continue;
+        ScopedTimer readTimer(statistics_ == nullptr ? nullptr :
+                              &statistics_->readSeconds);
+        ModuleProvider::Text text = provider.getText(name);
+        readTimer.stop();
+        if (statistics_ != nullptr && text.found) {
+            ++statistics_->filesRead;
+            statistics_->bytesRead += text.text.size();
+        }
+        if (text.found) {
+            modules.push_back(Module { std::move(name), std::move(text), 0,
+                                       std::vector<std::size_t>() });
+        }
     }
-    catch (const Error &) {
-        return 4;
+
+    // Build the include graph. Includes of modules that are not in the graph
+    // are ignored: such modules are expanded on demand.
+    const auto findModule = [&modules](const std::string & name) {
+        const auto less = [](const Module & m, const std::string & n) {
+            return m.name < n;
+        };
+        const auto it = std::lower_bound(modules.begin(), modules.end(),
+                                         name, less);
+        return it != modules.end() && it->name == name ?
+               static_cast<std::size_t>(it - modules.begin()) :
+               std::string::npos;
+    };
+    std::deque<std::size_t> ready;
+    for (std::size_t i = 0; i < modules.size(); ++i) {
+        std::vector<std::string> includes =
+            impl_->scanIncludes(modules[i].text.text);
+        std::sort(includes.begin(), includes.end());
+        includes.erase(std::unique(includes.begin(), includes.end()),
+                       includes.end());
+        for (const std::string & name : includes) {
+            const std::size_t included = findModule(name);
+            if (included != std::string::npos) {
+                ++modules[i].pendingIncludes;
+                modules[included].includers.push_back(i);
+            }
+        }
+        if (modules[i].pendingIncludes == 0)
+            ready.push_back(i);
     }
 
-    std::ofstream output(outputFile);
-    output << result;
-    try {
-        checkError(output, outputFile);
+    // Expand modules in topological order. Modules that belong to include
+    // cycles never become ready. Errors are not reported here: they are
+    // reported when a CMake file includes a failed module.
+    std::mutex mutex;
+    std::condition_variable readyChanged;
+    std::size_t busy = 0;
+    const auto work = [&](Impl & impl) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            readyChanged.wait(lock, [&] {
+                return ! ready.empty() || busy == 0;
+            });
+            if (ready.empty())
+                break;
+            const std::size_t i = ready.front();
+            ready.pop_front();
+            ++busy;
+            lock.unlock();
+
+            std::ostringstream ignoredErrors;
+            try {
+                impl.preExpandModule(modules[i].name, modules[i].text.text,
+                                     ignoredErrors);
+            }
+            catch (const Error &) {
+            }
+            modules[i].text = ModuleProvider::Text();
+
+            lock.lock();
+            --busy;
+            for (std::size_t includer : modules[i].includers) {
+                if (--modules[includer].pendingIncludes == 0)
+                    ready.push_back(includer);
+            }
+            readyChanged.notify_all();
+        }
+    };
+
+    runInThreads(actualThreadCount(threadCount, modules.size()), work);
+    collectStatistics();
+}
+
+int IncludeExpander::operator()(const std::vector<Job> & jobs,
+                                const std::string & modulesDir,
+                                unsigned threadCount,
+                                std::vector<Dependencies> * dependencies)
+{
+    cache_->setModulesDir(modulesDir, readMode_);
+    return expandJobs(jobs, threadCount, dependencies);
+}
+
+int IncludeExpander::operator()(const std::vector<Job> & jobs,
+                                const ModuleProvider & provider,
+                                unsigned threadCount,
+                                std::vector<Dependencies> * dependencies)
+{
+    cache_->setProvider(provider);
+    return expandJobs(jobs, threadCount, dependencies);
+}
+
+int IncludeExpander::writeBundle(const ModuleProvider & provider,
+                                 const std::string & bundleFile,
+                                 bool expandModules, unsigned threadCount)
+{
+    cache_->setProvider(provider);
+    if (expandModules)
+        preExpandAllModules(threadCount);
+
+    // Texts and expandedTexts own the memory that modules refer to. A deque
+    // never moves its elements when growing.
+    std::vector<ModuleProvider::Text> texts;
+    std::deque<std::string> expandedTexts;
+    std::vector<ModuleBundle::Module> modules;
+    for (std::string & name : provider.moduleNames()) {
+        ModuleProvider::Text text = provider.getText(name);
+        if (! text.found)
+            continue;
+        ModuleBundle::Module module;
+        module.text = text.text;
+        const ModuleCache::Entry * const entry = cache_->find(name);
+        if (expandModules && entry != nullptr) {
+            module.expanded = true;
+            expandedTexts.push_back(toString(entry->second.contents));
+            module.contents = expandedTexts.back();
+            module.dependencies = entry->second.dependencies;
+        }
+        module.name = std::move(name);
+        texts.push_back(std::move(text));
+        modules.push_back(std::move(module));
     }
-    catch (const Error &) {
+    if (! ModuleBundle::write(bundleFile, modules)) {
+        std::cerr << "Writing to file " << bundleFile << " failed."
+                  << std::endl;
         return 5;
     }
-
     return 0;
 }
+
+int IncludeExpander::expandJobs(const std::vector<Job> & jobs,
+                                unsigned threadCount,
+                                std::vector<Dependencies> * dependencies)
+{
+    threadCount = actualThreadCount(threadCount, jobs.size());
+    if (dependencies != nullptr)
+        dependencies->assign(jobs.size(), Dependencies());
+    const auto jobDependencies = [dependencies](std::size_t i) {
+        return dependencies == nullptr ? nullptr : &(*dependencies)[i];
+    };
+
+    int result = 0;
+    if (threadCount <= 1) {
+        for (std::size_t i = 0; i < jobs.size(); ++i) {
+            const int code = impl_->expandFile(
+                                 jobs[i].first, jobs[i].second, std::cerr,
+                                 outputOptions_, readMode_,
+                                 jobDependencies(i));
+            if (impl_->outputUnchanged())
+                ++unchangedOutputCount_;
+            if (result == 0)
+                result = code;
+        }
+        collectStatistics();
+        return result;
+    }
+
+    // Workers take jobs in order. Error messages are printed in the order of
+    // jobs after all jobs are finished, so that nothing depends on threadCount.
+    // Inputs are not mapped, because one job's output can be another job's
+    // input.
+    std::vector<int> codes(jobs.size());
+    std::vector<char> unchanged(jobs.size());
+    std::vector<std::string> messages(jobs.size());
+    std::atomic<std::size_t> nextJob(0);
+    const auto work = [&](Impl & impl) {
+        for (std::size_t i; (i = nextJob++) < jobs.size();) {
+            std::ostringstream errors;
+            codes[i] = impl.expandFile(
+                           jobs[i].first, jobs[i].second, errors,
+                           outputOptions_,
+                           CommonUtilities::MappedFile::readIntoBuffer,
+                           jobDependencies(i));
+            unchanged[i] = impl.outputUnchanged();
+            messages[i] = errors.str();
+        }
+    };
+    runInThreads(threadCount, work);
+    collectStatistics();
+
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        std::cerr << messages[i];
+        if (unchanged[i])
+            ++unchangedOutputCount_;
+        if (result == 0)
+            result = codes[i];
+    }
+    return result;
+}
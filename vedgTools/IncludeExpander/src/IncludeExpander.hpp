@@ -20,20 +20,35 @@
 # define INCLUDE_EXPANDER_HPP
 
 # include <CommonUtilities/FunctionConstant.hpp>
+# include <CommonUtilities/ConstString.hpp>
 # include <CommonUtilities/CopyAndMoveSemantics.hpp>
+# include <CommonUtilities/StringView.hpp>
+# include <CommonUtilities/Streams.hpp>
 
+# include <cstddef>
+# include <utility>
+# include <vector>
 # include <string>
 # include <memory>
+# include <iosfwd>
 
 
+struct Statistics;
+class ModuleProvider;
+
 class IncludeExpander
 {
 public:
-# define INCLUDE_EXPANDER_string_constant(name, value) \
-    CLASS_FUNCTION_CONSTANT(std::string, name, value)
+# define INCLUDE_EXPANDER_string_constant(name, value)                     \
+    CLASS_CONSTEXPR_FUNCTION_CONSTANT(                                      \
+        name, CommonUtilities::makeConstString(value))
 
+    /// Must be changed whenever expansion results can change.
+    INCLUDE_EXPANDER_string_constant(version, "2")
     INCLUDE_EXPANDER_string_constant(libraryCollection, "vedgTools")
-    INCLUDE_EXPANDER_string_constant(libraryPrefix, libraryCollection() + '/')
+    CLASS_CONSTEXPR_FUNCTION_CONSTANT(
+        libraryPrefix,
+        libraryCollection() + CommonUtilities::makeConstString("/"))
     INCLUDE_EXPANDER_string_constant(thisLibrary, "CMakeModules")
     INCLUDE_EXPANDER_string_constant(startCommand, "include")
     INCLUDE_EXPANDER_string_constant(startSeparator, "(")
@@ -44,14 +59,175 @@ public:
     NON_COPYABLE_BUT_MOVABLE(IncludeExpander)
     ~IncludeExpander() noexcept;
 
+    /// @brief Expands inputFile into outputFile ("-" means standard output).
+    /// Expanded modules are cached and reused by subsequent calls with the
+    /// same modulesDir. Unless the persistent cache is enabled, the output is
+    /// written while being expanded, so memory usage does not depend on its
+    /// size. In alwaysWrite mode, outputFile is written directly (it can be a
+    /// symlink, a FIFO or a device), so it is left incomplete if expansion
+    /// fails. In skipUnchanged mode, a regular outputFile is replaced only
+    /// after successful expansion.
     /// @return Exit code suitable to return from main().
     int operator()(const std::string & inputFile,
                    const std::string & outputFile,
                    const std::string & modulesDir);
 
+    /// @brief Expands input into output using modules from provider.
+    /// Expanded modules are cached and reused by subsequent calls with the
+    /// same provider object, so one IncludeExpander should serve many calls.
+    /// Calls with another provider or with modulesDir clear the cache.
+    /// Error messages are printed to errors.
+    /// @return false if expansion fails; output is not modified then.
+    bool expand(CommonUtilities::StringView input,
+                const ModuleProvider & provider, std::string & output,
+                std::ostream & errors);
+
+    /// @brief Same as above, but writes result to output while expanding, so
+    /// memory usage does not depend on its size. If expansion fails, part of
+    /// the result may be written.
+    /// @return false if expansion or writing fails.
+    bool expand(CommonUtilities::StringView input,
+                const ModuleProvider & provider, std::ostream & output,
+                std::ostream & errors);
+
+    enum OutputMode
+    {
+        /// Output files are always rewritten.
+        alwaysWrite,
+        /// Output files that already have the expanded contents are left
+        /// untouched (their modification time is preserved). Changed regular
+        /// files are replaced atomically via a temporary file.
+        skipUnchanged
+    };
+
+    /// @brief Sets the mode of writing expanded files (alwaysWrite by default).
+    void setOutputMode(OutputMode outputMode) {
+        outputOptions_.mode = outputMode;
+    }
+
+    /// @brief If depfileExtension is not empty, a Make/Ninja depfile named
+    /// outputFile + depfileExtension is written next to each expanded file
+    /// (but not for standard output).
+    /// It lists the input file and files of all modules included by it, so
+    /// that build systems can skip expansion when none of them changed.
+    void setDepfileExtension(std::string depfileExtension) {
+        outputOptions_.depfileExtension = std::move(depfileExtension);
+    }
+
+    /// @brief Sets how input files and module files in modulesDir are read
+    /// (mapIfPossible by default). readIntoBuffer must be used if these files
+    /// can be modified during expansion, e.g. by an editor in watch mode:
+    /// accessing a truncated mapping raises SIGBUS. Does not affect batch
+    /// inputs expanded in several threads, which are always read into
+    /// buffers.
+    void setReadMode(CommonUtilities::MappedFile::Mode readMode) {
+        readMode_ = readMode;
+    }
+
+    /// @return Number of outputs left untouched in skipUnchanged mode so far.
+    std::size_t unchangedOutputCount() const { return unchangedOutputCount_; }
+
+    /// @brief Enables or disables collection of statistics (disabled by
+    /// default). Statistics are collected cheaply, but not for free.
+    void setCollectingStatistics(bool collecting);
+
+    /// @return Statistics collected by all calls since collection was
+    /// enabled; nullptr if collection is disabled.
+    const Statistics * statistics() const { return statistics_.get(); }
+
+    /// @brief Enables persistent cache of expanded modules and CMake files in
+    /// directory cacheDir. Empty cacheDir disables it (default).
+    /// NOTE: cached CMake files are stored and loaded as a whole, so with the
+    /// cache enabled each expanded file is built in memory before being
+    /// written, and memory usage grows with its size.
+    void setCacheDir(const std::string & cacheDir);
+
+    /// @brief Expands all modules in modulesDir in advance, so that
+    /// subsequent calls with the same modulesDir only splice expanded modules
+    /// into CMake files. Scans modules' includes first and expands modules in
+    /// topological order; independent modules are expanded concurrently.
+    /// Errors are not reported: failed modules are expanded again (and errors
+    /// are reported) when a CMake file includes them.
+    /// @param threadCount See operator()(jobs, modulesDir, threadCount).
+    void preExpandModules(const std::string & modulesDir,
+                          unsigned threadCount = 1);
+
+    /// @brief Same as above for modules listed by provider.
+    void preExpandModules(const ModuleProvider & provider,
+                          unsigned threadCount = 1);
+
+    /// (inputFile, outputFile)
+    typedef std::pair<std::string, std::string> Job;
+    /// Sorted names of modules included by a CMake file (directly or
+    /// indirectly).
+    typedef std::vector<std::string> Dependencies;
+
+    /// @brief Expands each job's input into its output. Each module is read
+    /// and expanded at most once. A failed job does not stop the others.
+    /// @param threadCount Number of threads that expand jobs concurrently;
+    /// 0 means the number of hardware threads. Neither outputs nor error
+    /// messages nor return value depend on threadCount.
+    /// @param dependencies If not nullptr, is resized to jobs.size() and
+    /// receives dependencies of each job (empty if the job failed).
+    /// @return Exit code of the first failed job; 0 if all jobs succeeded.
+    int operator()(const std::vector<Job> & jobs,
+                   const std::string & modulesDir, unsigned threadCount = 1,
+                   std::vector<Dependencies> * dependencies = nullptr);
+
+    /// @brief Same as above with modules taken from provider.
+    int operator()(const std::vector<Job> & jobs,
+                   const ModuleProvider & provider, unsigned threadCount = 1,
+                   std::vector<Dependencies> * dependencies = nullptr);
+
+    /// @brief Packs all modules listed by provider into ModuleBundle file
+    /// bundleFile. If expandModules is true, expands the modules first (see
+    /// preExpandModules()) and stores expanded modules too, so that the
+    /// bundle's users don't expand them again. Modules that fail to expand
+    /// are stored as text only.
+    /// @return Exit code suitable to return from main().
+    int writeBundle(const ModuleProvider & provider,
+                    const std::string & bundleFile, bool expandModules,
+                    unsigned threadCount = 1);
+
+    /// @brief Forgets expanded moduleName and all expanded modules that
+    /// include it, so that they are read and expanded again when needed.
+    /// Must be called when moduleName's file changes.
+    void invalidateModule(const std::string & moduleName);
+
+    /// @brief Forgets all expanded modules.
+    void clearCache();
+
 private:
+    class ModuleCache;
     class Impl;
+
+    /// @brief Calls work(impl) in threadCount threads: with impl_ in the
+    /// calling thread and with new Impl instances in the other ones.
+    template <class Work>
+    void runInThreads(unsigned threadCount, Work work);
+
+    /// @brief Implements operator()(jobs, ...) for the current provider.
+    int expandJobs(const std::vector<Job> & jobs, unsigned threadCount,
+                   std::vector<Dependencies> * dependencies);
+
+    /// @brief Implements preExpandModules() for the current provider.
+    void preExpandAllModules(unsigned threadCount);
+
+    /// @brief Moves statistics collected by impl_ to statistics_.
+    void collectStatistics();
+
+    std::unique_ptr<ModuleCache> cache_;
+    struct OutputOptions {
+        OutputMode mode = alwaysWrite;
+        std::string depfileExtension;
+    };
+
     std::unique_ptr<Impl> impl_;
+    OutputOptions outputOptions_;
+    CommonUtilities::MappedFile::Mode readMode_ =
+        CommonUtilities::MappedFile::mapIfPossible;
+    std::size_t unchangedOutputCount_ = 0;
+    std::unique_ptr<Statistics> statistics_;
 };
 
 # endif // INCLUDE_EXPANDER_HPP
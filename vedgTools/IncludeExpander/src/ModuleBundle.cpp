@@ -0,0 +1,233 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# include "ModuleBundle.hpp"
+
+# include "IncludeExpander.hpp"
+
+# include <CommonUtilities/StringView.hpp>
+# include <CommonUtilities/String.hpp>
+# include <CommonUtilities/Streams.hpp>
+
+# include <cstddef>
+# include <utility>
+# include <algorithm>
+# include <array>
+# include <vector>
+# include <string>
+
+
+namespace
+{
+using CommonUtilities::StringView;
+using CommonUtilities::String::readLine;
+using CommonUtilities::String::parseUnsigned;
+
+const std::string & header()
+{
+    static const std::string value = "include_expander bundle 1\n";
+    return value;
+}
+
+/// @brief Parses N space-separated decimal numbers.
+/// @return false if line does not consist of exactly N numbers.
+template <std::size_t N>
+bool parseNumbers(StringView line, std::array<std::size_t, N> & numbers)
+{
+    std::size_t begin = 0;
+    for (std::size_t i = 0; i < N; ++i) {
+        std::size_t end = line.find(' ', begin);
+        if ((end == std::string::npos) != (i + 1 == N))
+            return false;
+        if (end == std::string::npos)
+            end = line.size();
+        if (! parseUnsigned(line.substr(begin, end - begin), 10, numbers[i]))
+            return false;
+        begin = end + 1;
+    }
+    return true;
+}
+
+/// @return data.substr(offset, size); false if it is out of data.
+bool getRange(StringView data, std::size_t offset, std::size_t size,
+              StringView & range)
+{
+    if (offset > data.size() || size > data.size() - offset)
+        return false;
+    range = data.substr(offset, size);
+    return true;
+}
+
+} // END unnamed namespace
+
+
+bool ModuleBundle::write(const std::string & filename,
+                         const std::vector<Module> & modules)
+{
+    std::string result = header();
+    result += IncludeExpander::version();
+    result += '\n';
+    result += std::to_string(modules.size());
+    result += '\n';
+    std::string data;
+    for (const Module & module : modules) {
+        result += module.name;
+        result += '\n';
+        result += std::to_string(data.size()) + ' ' +
+                  std::to_string(module.text.size()) + '\n';
+        data += module.text;
+        if (module.expanded) {
+            // Modules without includes are stored once.
+            const bool same = module.contents == module.text;
+            const std::size_t offset =
+                same ? data.size() - module.text.size() : data.size();
+            result += std::to_string(offset) + ' ' +
+                      std::to_string(module.contents.size()) + ' ' +
+                      std::to_string(module.dependencies.size()) + '\n';
+            if (! same)
+                data += module.contents;
+            for (const std::string & dependency : module.dependencies) {
+                result += dependency;
+                result += '\n';
+            }
+        }
+        else
+            result += "-\n";
+    }
+    result += data;
+    return CommonUtilities::replaceFileContents(filename, result);
+}
+
+ModuleBundle::ModuleBundle(const std::string & filename)
+    : file_(filename), fine_(file_.isFine() && parse())
+{
+    if (! fine_)
+        modules_.clear();
+}
+
+ModuleProvider::Text ModuleBundle::getText(
+    const std::string & moduleName) const
+{
+    Text result;
+    if (const Module * const module = find(moduleName)) {
+        result.found = true;
+        result.text = module->text;
+    }
+    return result;
+}
+
+std::vector<std::string> ModuleBundle::moduleNames() const
+{
+    std::vector<std::string> result;
+    result.reserve(modules_.size());
+    for (const Module & module : modules_)
+        result.push_back(module.name);
+    return result;
+}
+
+bool ModuleBundle::getExpanded(const std::string & moduleName, Text & contents,
+                               std::vector<std::string> & dependencies) const
+{
+    const Module * const module = find(moduleName);
+    if (module == nullptr || ! module->expanded)
+        return false;
+    contents.found = true;
+    contents.text = module->contents;
+    contents.owner.reset();
+    dependencies = module->dependencies;
+    return true;
+}
+
+bool ModuleBundle::parse()
+{
+    const StringView source = file_.view();
+    if (source.compare(0, header().size(), header()) != 0)
+        return false;
+    std::size_t index = header().size();
+    StringView version, line;
+    std::size_t count;
+    if (! readLine(source, index, version) ||
+            ! readLine(source, index, line) ||
+            ! parseUnsigned(line, 10, count)) {
+        return false;
+    }
+    // Expanded modules written by another version may differ.
+    const bool expandedUsable = version == IncludeExpander::version();
+
+    /// (text offset, text size, expanded offset, expanded size)
+    std::vector<std::array<std::size_t, 4>> ranges;
+    for (std::size_t i = 0; i < count; ++i) {
+        Module module;
+        if (! readLine(source, index, line) || line.empty() ||
+                (! modules_.empty() &&
+                 StringView(modules_.back().name).compare(line) >= 0)) {
+            return false;
+        }
+        module.name = std::string(line);
+
+        std::array<std::size_t, 4> range {{}};
+        std::array<std::size_t, 2> textRange;
+        if (! readLine(source, index, line) || ! parseNumbers(line, textRange))
+            return false;
+        range[0] = textRange[0];
+        range[1] = textRange[1];
+
+        if (! readLine(source, index, line))
+            return false;
+        if (line != "-") {
+            std::array<std::size_t, 3> expandedRange;
+            if (! parseNumbers(line, expandedRange))
+                return false;
+            for (std::size_t d = 0; d < expandedRange[2]; ++d) {
+                if (! readLine(source, index, line))
+                    return false;
+                module.dependencies.push_back(std::string(line));
+            }
+            module.expanded = expandedUsable;
+            range[2] = expandedRange[0];
+            range[3] = expandedRange[1];
+        }
+        modules_.push_back(std::move(module));
+        ranges.push_back(range);
+    }
+
+    const StringView data = source.substr(index);
+    for (std::size_t i = 0; i < modules_.size(); ++i) {
+        Module & module = modules_[i];
+        if (! getRange(data, ranges[i][0], ranges[i][1], module.text) ||
+                (module.expanded &&
+                 ! getRange(data, ranges[i][2], ranges[i][3],
+                            module.contents))) {
+            return false;
+        }
+        if (! module.expanded)
+            module.dependencies.clear();
+    }
+    return true;
+}
+
+const ModuleBundle::Module * ModuleBundle::find(
+    const std::string & moduleName) const
+{
+    const auto it = std::lower_bound(
+                        modules_.begin(), modules_.end(), moduleName,
+    [](const Module & module, const std::string & name) {
+        return module.name < name;
+    });
+    return it != modules_.end() && it->name == moduleName ? &*it : nullptr;
+}
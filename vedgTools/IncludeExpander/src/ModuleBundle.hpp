@@ -0,0 +1,92 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# ifndef INCLUDE_EXPANDER_MODULE_BUNDLE_HPP
+# define INCLUDE_EXPANDER_MODULE_BUNDLE_HPP
+
+# include "ModuleProvider.hpp"
+
+# include <CommonUtilities/StringView.hpp>
+# include <CommonUtilities/Streams.hpp>
+
+# include <vector>
+# include <string>
+
+
+/// @brief Modules packed into a single indexed file, which is mapped at once
+/// instead of opening a file per module. Each module is stored as text and,
+/// optionally, in expanded form together with its dependencies. Expanded
+/// modules are used only by the IncludeExpander::version() that wrote them.
+/// Format (all numbers are decimal, offsets are relative to the data that
+/// follows the index):
+///     include_expander bundle 1
+///     <IncludeExpander::version()>
+///     <module count>
+/// then for each module (sorted by name):
+///     <name>
+///     <text offset> <text size>
+///     <expanded offset> <expanded size> <dependency count>  (or "-")
+///     <dependency> (one per line)
+/// then data.
+class ModuleBundle : public ModuleProvider
+{
+public:
+    struct Module {
+        std::string name;
+        CommonUtilities::StringView text;
+        /// true if contents and dependencies are present.
+        bool expanded = false;
+        CommonUtilities::StringView contents;
+        /// Sorted names of modules included by this one (directly or
+        /// indirectly).
+        std::vector<std::string> dependencies;
+    };
+
+    /// @brief Writes modules to bundle file filename atomically.
+    /// @param modules Must be sorted by name.
+    /// @return false in case of filesystem error.
+    static bool write(const std::string & filename,
+                      const std::vector<Module> & modules);
+
+    /// @brief Maps bundle file filename.
+    explicit ModuleBundle(const std::string & filename);
+
+    /// @return false if the file can not be read or is not a valid bundle.
+    /// The bundle has no modules then.
+    bool isFine() const { return fine_; }
+
+    Text getText(const std::string & moduleName) const override;
+    std::vector<std::string> moduleNames() const override;
+    bool getExpanded(const std::string & moduleName, Text & contents,
+                     std::vector<std::string> & dependencies) const override;
+
+private:
+    /// @brief Parses the index of file_ into modules_.
+    /// @return false if the index is invalid.
+    bool parse();
+
+    /// @return Module moduleName; nullptr if it is missing.
+    const Module * find(const std::string & moduleName) const;
+
+    const CommonUtilities::MappedFile file_;
+    /// Sorted by name.
+    std::vector<Module> modules_;
+    bool fine_;
+};
+
+# endif // INCLUDE_EXPANDER_MODULE_BUNDLE_HPP
@@ -0,0 +1,102 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# include "ModuleProvider.hpp"
+
+# include <CommonUtilities/Streams.hpp>
+
+# include <utility>
+# include <algorithm>
+# include <memory>
+# include <vector>
+# include <string>
+
+# if defined(__unix__) || defined(__APPLE__)
+#   include <dirent.h>
+#   define MODULE_PROVIDER_HAS_DIRENT 1
+# else
+#   define MODULE_PROVIDER_HAS_DIRENT 0
+# endif
+
+
+ModuleProvider::~ModuleProvider() noexcept = default;
+
+std::vector<std::string> ModuleProvider::moduleNames() const
+{
+    return std::vector<std::string>();
+}
+
+bool ModuleProvider::getExpanded(const std::string &, Text &,
+                                 std::vector<std::string> &) const
+{
+    return false;
+}
+
+std::string ModuleProvider::filename(const std::string &) const
+{
+    return std::string();
+}
+
+
+FileModuleProvider::FileModuleProvider(
+    std::string modulesDir, CommonUtilities::MappedFile::Mode readMode)
+    : modulesDir_(std::move(modulesDir)), readMode_(readMode)
+{
+    if (! modulesDir_.empty() && modulesDir_.back() != '/')
+        modulesDir_ += '/';
+}
+
+ModuleProvider::Text FileModuleProvider::getText(
+    const std::string & moduleName) const
+{
+    const auto file = std::make_shared<CommonUtilities::MappedFile>(
+                          filename(moduleName), readMode_);
+    Text result;
+    result.found = file->isFine();
+    result.text = file->view();
+    result.owner = file;
+    return result;
+}
+
+std::vector<std::string> FileModuleProvider::moduleNames() const
+{
+    std::vector<std::string> result;
+# if MODULE_PROVIDER_HAS_DIRENT
+    DIR * const stream =
+        ::opendir(modulesDir_.empty() ? "." : modulesDir_.c_str());
+    if (stream == nullptr)
+        return result;
+    const std::string extension = ".cmake";
+    while (const dirent * const entry = ::readdir(stream)) {
+        const std::string name = entry->d_name;
+        if (name.size() > extension.size() &&
+                name.compare(name.size() - extension.size(), extension.size(),
+                             extension) == 0) {
+            result.push_back(name.substr(0, name.size() - extension.size()));
+        }
+    }
+    ::closedir(stream);
+    std::sort(result.begin(), result.end());
+# endif
+    return result;
+}
+
+std::string FileModuleProvider::filename(const std::string & moduleName) const
+{
+    return modulesDir_ + moduleName + ".cmake";
+}
@@ -0,0 +1,99 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# ifndef INCLUDE_EXPANDER_MODULE_PROVIDER_HPP
+# define INCLUDE_EXPANDER_MODULE_PROVIDER_HPP
+
+# include <CommonUtilities/StringView.hpp>
+# include <CommonUtilities/Streams.hpp>
+
+# include <memory>
+# include <vector>
+# include <string>
+
+
+/// @brief Source of module texts. Module name is the part of include after
+/// the library prefix, e.g. "LibraryInit" for include(vedgTools/LibraryInit).
+/// WARNING: IncludeExpander calls providers from several threads at once in
+/// multithreaded mode, so implementations must be thread-safe.
+class ModuleProvider
+{
+public:
+    struct Text {
+        /// false if the module does not exist or can not be read.
+        bool found = false;
+        CommonUtilities::StringView text;
+        /// Keeps text valid while this object exists; may be nullptr if text
+        /// lives as long as the provider.
+        std::shared_ptr<const void> owner;
+    };
+
+    virtual ~ModuleProvider() noexcept;
+
+    /// @return Text of module moduleName.
+    virtual Text getText(const std::string & moduleName) const = 0;
+
+    /// @return Sorted names of all available modules; empty vector if
+    /// listing is not supported. Is used by
+    /// IncludeExpander::preExpandModules().
+    virtual std::vector<std::string> moduleNames() const;
+
+    /// @brief Supplies module moduleName in already expanded form, so that
+    /// IncludeExpander uses it as is. The expansion must have been performed
+    /// by the same IncludeExpander::version().
+    /// @param dependencies Receives sorted names of all modules that were
+    /// included during expansion of moduleName (directly or indirectly).
+    /// @return false if expanded moduleName is not available (default).
+    virtual bool getExpanded(const std::string & moduleName, Text & contents,
+                             std::vector<std::string> & dependencies) const;
+
+    /// @return Name of the file that contains module moduleName; empty
+    /// string if modules are not stored in files. Is used in error messages
+    /// and depfiles.
+    virtual std::string filename(const std::string & moduleName) const;
+};
+
+
+/// @brief Reads modules from "<moduleName>.cmake" files in a directory.
+class FileModuleProvider : public ModuleProvider
+{
+public:
+    /// @param modulesDir Directory that contains cmake modules. Empty string
+    /// means the current directory.
+    /// @param readMode Must be readIntoBuffer if module files can be modified
+    /// while their texts are used.
+    explicit FileModuleProvider(
+        std::string modulesDir,
+        CommonUtilities::MappedFile::Mode readMode =
+            CommonUtilities::MappedFile::mapIfPossible);
+
+    /// @return modulesDir with trailing '/' (if it is not empty).
+    const std::string & modulesDir() const { return modulesDir_; }
+    CommonUtilities::MappedFile::Mode readMode() const { return readMode_; }
+
+    Text getText(const std::string & moduleName) const override;
+    /// NOTE: returns empty vector on platforms without <dirent.h>.
+    std::vector<std::string> moduleNames() const override;
+    std::string filename(const std::string & moduleName) const override;
+
+private:
+    std::string modulesDir_;
+    CommonUtilities::MappedFile::Mode readMode_;
+};
+
+# endif // INCLUDE_EXPANDER_MODULE_PROVIDER_HPP
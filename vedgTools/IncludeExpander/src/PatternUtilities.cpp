@@ -29,10 +29,7 @@ namespace PatternUtilities
 Pattern::~Pattern() noexcept = default;
 
 
-SkippingPattern::~SkippingPattern() noexcept = default;
-
-
-bool Whitespace::match(const std::string & source, std::size_t & index)
+bool Whitespace::match(StringView source, std::size_t & index)
 {
     if (index < source.size() && safeCtype<std::isspace>(source[index])) {
         ++index;
@@ -42,103 +39,116 @@ bool Whitespace::match(const std::string & source, std::size_t & index)
 }
 
 
-bool Param::match(const std::string & source, std::size_t & index)
+bool SearchSymbol::match(StringView source, std::size_t & index)
 {
-    discarder_(source, index);
-    std::size_t end = index;
-    Str::skipIf(source, end, [](char c) {
-        return !(c == ')' || safeCtype<std::isspace>(c));
-    });
-    if (end == index)
+    index = source.find(symbol_, index);
+    if (index == std::string::npos)
         return false;
-    param_ = source.substr(index, end - index);
-    index = end;
+    symbolPosition_ = index++;
     return true;
 }
 
 
-bool ParamCopy::match(const std::string & source, std::size_t & index)
+void SearchStringLine::findStr(StringView source,
+                               std::size_t & index) const
 {
-    return String(param_.getParam(), discarder_).match(source, index);
+    index = source.find(str_, index);
 }
 
 
-bool SearchSymbol::match(const std::string & source, std::size_t & index)
+SearchCiStringLine::SearchCiStringLine(const std::string & lowerStr)
+    : lowerStr_(lowerStr)
 {
-    index = source.find(symbol_, index);
-    if (index == std::string::npos)
-        return false;
-    symbolPosition_ = index++;
-    return true;
+    if (lowerStr.empty()) {
+        throw std::runtime_error(
+            "Don't pass empty string to SearchCiStringLine constructor.");
+    }
 }
 
-
-bool SearchLine::match(const std::string & source, std::size_t & index)
+void SearchCiStringLine::findStr(StringView source,
+                                 std::size_t & index) const
 {
-    while (findStr(source, index), index != std::string::npos) {
-        patternBeginning_ = index;
-        lineBeginning_ = Str::Backward::findEolOrNonWs(source, 0, index);
-        if (lineBeginning_ == Str::npos())
-            lineBeginning_ = 0;
-        else if (source[lineBeginning_] == '\n')
-            ++lineBeginning_;
-        else {
-            // Not at the beginning of the line -> continue search.
-            index = source.find('\n', index);
-            if (index == std::string::npos)
-                break;
-            ++index;
-            continue;
-        }
-        index += size();
-        return true;
+    if (index >= source.size()) {
+        index = std::string::npos;
+        return;
     }
-    return false;
+    const char * const found = CommonUtilities::CaseFold::find(
+                                   source.begin() + index, source.end(),
+                                   lowerStr_);
+    index = found == source.end() ? std::string::npos :
+            static_cast<std::size_t>(found - source.begin());
 }
 
 
-void SearchStringLine::findStr(const std::string & source, std::size_t & index)
+std::size_t SearchKeywordLine::addKeyword(StringView keyword,
+                                          CaseSensitivity sensitivity)
 {
-    index = source.find(str_, index);
+    if (keyword.empty()) {
+        throw std::runtime_error(
+            "Don't pass empty keyword to SearchKeywordLine.");
+    }
+    const std::size_t id = keywords_.size();
+    const char first = keyword.front();
+    candidates_[static_cast<unsigned char>(first)].push_back(id);
+    if (sensitivity == caseInsensitive) {
+        const char upper = static_cast<char>(safeCtype<std::toupper>(first));
+        if (upper != first)
+            candidates_[static_cast<unsigned char>(upper)].push_back(id);
+    }
+    keywords_.push_back({ keyword, sensitivity });
+    return id;
 }
 
-
-SearchCiStringLine::SearchCiStringLine(const std::string & lowerStr)
-    : lowerStrWithoutFirstSymbol_(
-        lowerStr.empty() ? std::string() : lowerStr.substr(1))
+bool SearchKeywordLine::match(StringView source, std::size_t & index)
 {
-    if (lowerStr.empty()) {
-        throw std::runtime_error(
-            "Don't pass empty string to SearchCiStringLine constructor.");
+    if (index >= source.size()) {
+        index = std::string::npos;
+        return false;
     }
-    const char lower = lowerStr.front();
-    const char upper = static_cast<char>(safeCtype<std::toupper>(lower));
-    if (lower == upper)
-        firstSymbol_ = { lower };
-    else
-        firstSymbol_ = { lower, upper };
+    std::size_t lineBeginning = lineBeginningBefore(source, index);
+    std::size_t pos = index;
+    while (true) {
+        if (lineBeginning == std::string::npos) {
+            // Not at the beginning of the line -> continue from the next one.
+            lineBeginning = source.find('\n', pos);
+            if (lineBeginning == std::string::npos)
+                break;
+            pos = ++lineBeginning;
+        }
+        Str::skipWsExceptEol(source, pos);
+        if (pos == source.size())
+            break;
+        keywordId_ = findKeyword(source, pos);
+        if (keywordId_ != std::string::npos) {
+            setMatchPositions(lineBeginning, pos);
+            index = pos + keywords_[keywordId_].str.size();
+            return true;
+        }
+        lineBeginning = std::string::npos;
+    }
+    index = std::string::npos;
+    return false;
 }
 
-void SearchCiStringLine::findStr(const std::string & source,
-                                 std::size_t & index)
+std::size_t SearchKeywordLine::findKeyword(StringView source,
+                                           std::size_t index) const
 {
-    while ((index = source.find_first_of(firstSymbol_, index))
-            != std::string::npos) {
-        ++index;
-        if (CiString(lowerStrWithoutFirstSymbol_).match(source, index)) {
-            index -= size();
-            break;
+    for (std::size_t id :
+            candidates_[static_cast<unsigned char>(source[index])]) {
+        const Keyword & keyword = keywords_[id];
+        if (keyword.sensitivity == caseSensitive ?
+                matchesAt<std::equal_to<char>>(source, index, keyword.str) :
+                matchesAt<LowerMixedCaseCiCharComparator>(source, index,
+                                                          keyword.str)) {
+            return id;
         }
-        index = source.find('\n', index);
-        if (index == std::string::npos)
-            break;
-        ++index;
     }
+    return std::string::npos;
 }
 
 
 
-bool PatternMatcher::match(const std::string & source, std::size_t & index)
+bool PatternMatcher::match(StringView source, std::size_t & index)
 {
     while (patternId_ < patternSequence_.size()) {
         if (patternSequence_[patternId_]->match(source, index))
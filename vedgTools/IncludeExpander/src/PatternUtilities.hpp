@@ -20,13 +20,20 @@
 # define PATTERN_UTILITIES_HPP
 
 # include <CommonUtilities/CopyAndMoveSemantics.hpp>
+# include <CommonUtilities/StringView.hpp>
+# include <CommonUtilities/ConstString.hpp>
 # include <CommonUtilities/String.hpp>
+# include <CommonUtilities/CharScan.hpp>
+# include <CommonUtilities/CaseFold.hpp>
 
 # include <cstddef>
 # include <cctype>
 # include <utility>
 # include <functional>
+# include <type_traits>
 # include <algorithm>
+# include <tuple>
+# include <array>
 # include <vector>
 # include <string>
 
@@ -37,7 +44,9 @@
 namespace PatternUtilities
 {
 using CommonUtilities::safeCtype;
+using CommonUtilities::StringView;
 namespace Str = CommonUtilities::String;
+namespace CharScan = CommonUtilities::CharScan;
 
 class Pattern
 {
@@ -47,7 +56,7 @@ public:
     /// match index will point to the position in source after last matched
     /// symbol. Otherwise, index's final value is defined by derived classes.
     /// @return true in case of match, false otherwise.
-    virtual bool match(const std::string & source, std::size_t & index) = 0;
+    virtual bool match(StringView source, std::size_t & index) = 0;
 
     Pattern() = default;
     COPYABLE_AND_MOVABLE(Pattern)
@@ -55,18 +64,49 @@ public:
 };
 
 
-class SkippingPattern : public Pattern
+/// @brief Type-erased discarder. Can hold any function or functor that has
+/// signature void(StringView str, std::size_t & index).
+typedef std::function<void(StringView str, std::size_t & index)>
+DynamicDiscarder;
+
+/// @brief Equivalent to discarder function, but its type can be passed to
+/// patterns as a template argument. Such discarder is called directly and can
+/// be inlined into match().
+template <void (& discarder)(StringView str, std::size_t & index)>
+struct StaticDiscarder {
+    void operator()(StringView str, std::size_t & index) const {
+        discarder(str, index);
+    }
+};
+
+typedef StaticDiscarder<Str::noSkip> NoSkip;
+typedef StaticDiscarder<Str::skipWs> SkipWs;
+typedef StaticDiscarder<Str::skipWsExceptEol> SkipWsExceptEol;
+typedef StaticDiscarder<Str::skipBlank> SkipBlank;
+
+/// @return Discarder that is used by patterns if none is specified:
+/// value-initialized Discarder; Str::noSkip in case of DynamicDiscarder.
+template <class Discarder>
+Discarder defaultDiscarder() { return Discarder(); }
+
+template <>
+inline DynamicDiscarder defaultDiscarder<DynamicDiscarder>()
+{
+    return NoSkip();
+}
+
+
+/// @tparam DiscarderType DynamicDiscarder or a functor type such as SkipWs.
+template <class DiscarderType>
+class BasicSkippingPattern : public Pattern
 {
 public:
-    typedef std::function<void(const std::string & str, std::size_t & index)>
-    Discarder;
+    typedef DiscarderType Discarder;
 
-    explicit SkippingPattern(Discarder discarder = Str::noSkip)
+    explicit BasicSkippingPattern(
+        Discarder discarder = defaultDiscarder<Discarder>())
         : discarder_(std::move(discarder)) {}
 
-    COPYABLE_AND_MOVABLE(SkippingPattern)
-    ~SkippingPattern() noexcept override;
-
     /// @brief First discarder_(source, index) is called - it can change index.
     /// Then, if X symbols of source starting from index match this pattern,
     /// index becomes equal to index + X. Otherwise, index is not changed at
@@ -77,30 +117,84 @@ protected:
     const Discarder discarder_;
 };
 
+typedef BasicSkippingPattern<DynamicDiscarder> SkippingPattern;
+
 
 class Whitespace : public Pattern
 {
 public:
     /// @brief Matches if source[index] is a whitespace.
     /// If matched, index is incremented; otherwise index is not changed.
-    bool match(const std::string & source, std::size_t & index) override;
+    bool match(StringView source, std::size_t & index) override;
 };
 
 
+/// @return true if str matches source starting from index according to
+/// CharComparator, which is called as comparator(strChar, sourceChar).
 template <class CharComparator>
-class GenericString : public SkippingPattern
+inline bool matchesAt(StringView source, std::size_t index, StringView str)
+{
+    return index <= source.size() && str.size() <= source.size() - index &&
+           std::equal(str.begin(), str.end(),
+                      source.begin() + static_cast<std::ptrdiff_t>(index),
+                      CharComparator());
+}
+
+/// Compares lowercase char with mixed-case char, folding the case of the
+/// latter as std::tolower() does in the "C" locale.
+struct LowerMixedCaseCiCharComparator {
+    constexpr bool operator()(char lower, char mixed) const {
+        return CommonUtilities::CaseFold::toLower(mixed) == lower;
+    }
+};
+
+/// Compares several chars at a time.
+template <>
+inline bool matchesAt<LowerMixedCaseCiCharComparator>(
+    StringView source, std::size_t index, StringView str)
+{
+    return index <= source.size() && str.size() <= source.size() - index &&
+           CommonUtilities::CaseFold::equals(str.data(), source.data() + index,
+                                             str.size());
+}
+
+
+/// @brief Is true for std::string and ConstString: types whose temporaries
+/// would be destroyed before a StringView to them is used.
+template <class T>
+struct IsOwningString : std::false_type {};
+
+template <>
+struct IsOwningString<std::string> : std::true_type {};
+
+template <std::size_t N>
+struct IsOwningString<CommonUtilities::ConstString<N>> : std::true_type {};
+
+
+/// @tparam Storage std::string or StringView.
+/// WARNING: if Storage is StringView, str is not copied, so it must outlive
+/// the pattern. Pass string literals or ConstString constants with static
+/// storage duration.
+template <class CharComparator, class Discarder = DynamicDiscarder,
+          class Storage = StringView>
+class GenericString : public BasicSkippingPattern<Discarder>
 {
 public:
-    explicit GenericString(std::string str, Discarder discarder = Str::noSkip)
-        : SkippingPattern(std::move(discarder)), str_(std::move(str)) {}
+    explicit GenericString(Storage str,
+                           Discarder discarder = defaultDiscarder<Discarder>())
+        : BasicSkippingPattern<Discarder>(std::move(discarder)),
+          str_(std::move(str)) {}
+    /// Temporary string would be destroyed before the pattern is used.
+    template <class Str, class = typename std::enable_if<
+                  std::is_same<Storage, StringView>::value &&
+                  IsOwningString<Str>::value>::type>
+    explicit GenericString(Str &&,
+                           Discarder = defaultDiscarder<Discarder>()) = delete;
 
     /// @brief Matches str_.
-    bool match(const std::string & source, std::size_t & index) override {
-        discarder_(source, index);
-        if (index + str_.size() <= source.size() &&
-                std::equal(str_.begin(), str_.end(),
-                           source.begin() + static_cast<std::ptrdiff_t>(index),
-                           CharComparator())) {
+    bool match(StringView source, std::size_t & index) override {
+        this->discarder_(source, index);
+        if (matchesAt<CharComparator>(source, index, str_)) {
             index += str_.size();
             return true;
         }
@@ -108,36 +202,48 @@ public:
     }
 
 private:
-    const std::string str_;
+    const Storage str_;
 };
 
-typedef GenericString<std::equal_to<char>> String;
+template <class Discarder>
+using StaticString = GenericString<std::equal_to<char>, Discarder>;
+/// Copies str, so it can be constructed from any string.
+typedef GenericString<std::equal_to<char>, DynamicDiscarder, std::string>
+String;
 
-struct LowerMixedCaseCiCharComparator {
-    constexpr bool operator()(char lower, char mixed) const {
-        return CommonUtilities::safeCtypeCast(lower) ==
-               safeCtype<std::tolower>(mixed);
-    }
-};
 /// Case-insensitive String.
 /// WARNING: CiString constructor parameter 'str' must be in lowercase.
-typedef GenericString<LowerMixedCaseCiCharComparator> CiString;
+template <class Discarder>
+using StaticCiString = GenericString<LowerMixedCaseCiCharComparator, Discarder>;
+typedef GenericString<LowerMixedCaseCiCharComparator, DynamicDiscarder,
+                      std::string> CiString;
 
 
-class Param : public SkippingPattern
+template <class Discarder>
+class BasicParam : public BasicSkippingPattern<Discarder>
 {
 public:
 # define NO_inheriting_constructors GCC_EARLIER_THAN_4_8
 # if NO_inheriting_constructors
-    explicit Param(Discarder discarder = Str::noSkip)
-        : SkippingPattern(std::move(discarder)) {}
+    explicit BasicParam(Discarder discarder = defaultDiscarder<Discarder>())
+        : BasicSkippingPattern<Discarder>(std::move(discarder)) {}
 # else
-    using SkippingPattern::SkippingPattern;
+    using BasicSkippingPattern<Discarder>::BasicSkippingPattern;
 # endif
 # undef NO_inheriting_constructors
 
     /// @brief Matches any sequence of non-whitespace and not ')' characters.
-    bool match(const std::string & source, std::size_t & index) override;
+    bool match(StringView source, std::size_t & index) override {
+        this->discarder_(source, index);
+        const std::size_t end = static_cast<std::size_t>(
+            CharScan::find<CharScan::spaceOrClosingParen>(
+                source.begin() + index, source.end()) - source.begin());
+        if (end == index)
+            return false;
+        param_.assign(source.data() + index, end - index);
+        index = end;
+        return true;
+    }
 
     /// @return Last matched param. If match has never occurred, empty string.
     const std::string & getParam() const { return param_; }
@@ -146,20 +252,35 @@ private:
     std::string param_;
 };
 
+typedef BasicParam<DynamicDiscarder> Param;
 
-class ParamCopy : public SkippingPattern
+
+template <class Discarder>
+class BasicParamCopy : public BasicSkippingPattern<Discarder>
 {
 public:
-    explicit ParamCopy(const Param & param, Discarder discarder = Str::noSkip)
-        : SkippingPattern(std::move(discarder)), param_(param) {}
-
-    /// @brief Matches param_.getParam().
-    bool match(const std::string & source, std::size_t & index) override;
+    template <class ParamDiscarder>
+    explicit BasicParamCopy(const BasicParam<ParamDiscarder> & param,
+                            Discarder discarder = defaultDiscarder<Discarder>())
+        : BasicSkippingPattern<Discarder>(std::move(discarder)),
+          param_(param.getParam()) {}
+
+    /// @brief Matches current value of param.getParam().
+    bool match(StringView source, std::size_t & index) override {
+        this->discarder_(source, index);
+        if (matchesAt<std::equal_to<char>>(source, index, param_)) {
+            index += param_.size();
+            return true;
+        }
+        return false;
+    }
 
 private:
-    const Param & param_;
+    const std::string & param_;
 };
 
+typedef BasicParamCopy<DynamicDiscarder> ParamCopy;
+
 
 class SearchSymbol : public Pattern
 {
@@ -170,7 +291,7 @@ public:
     /// @param index If symbol_ was found, points to the position in source
     /// right after the position of symbol_; otherwise index's resulting value
     /// is std::string::npos.
-    bool match(const std::string & source, std::size_t & index) override;
+    bool match(StringView source, std::size_t & index) override;
 
     /// @return Position of the found symbol_ in source. Undefined
     /// number if match has never occurred.
@@ -192,7 +313,7 @@ public:
     /// @param index If line was found, points to first symbol in source after
     /// the last matched symbol (not necessarily last symbol of the line).
     /// Otherwise, index's resulting value is std::string::npos.
-    bool match(const std::string & source, std::size_t & index) override;
+    // bool match(...) override = 0;
 
     /// @return Position of the beginning of matched line in source. Undefined
     /// number if match has never occurred.
@@ -202,58 +323,173 @@ public:
     /// Undefined number if match has never occurred.
     std::size_t getPatternBeginning() const { return patternBeginning_; }
 
-private:
-    /// @brief Finds desired pattern. Is used in match().
-    /// @param index Is set to position in source of the first symbol of matched
-    /// pattern. If pattern wasn't found, is set to std::string::npos.
-    virtual void findStr(const std::string & source, std::size_t & index) = 0;
+    /// @brief Makes match() treat position lineBoundary in source as the
+    /// beginning of a line. Symbols before lineBoundary are ignored when
+    /// checking that the found pattern starts the line. Default value is 0.
+    void setLineBoundary(std::size_t lineBoundary) {
+        lineBoundary_ = lineBoundary;
+    }
 
-    /// @brief Is used in match().
-    /// @return Length of matched pattern.
-    virtual std::size_t size() const = 0;
+protected:
+    /// @brief Implements match() in derived classes.
+    /// @tparam Derived Must provide (possibly private if SearchLine is a
+    /// friend) member functions, which are called without virtual dispatch:
+    /// void findStr(StringView source, std::size_t & index) const - finds
+    /// desired pattern, sets index to position in source of the first symbol
+    /// of matched pattern or to std::string::npos if pattern wasn't found;
+    /// std::size_t size() const - returns length of matched pattern.
+    template <class Derived>
+    bool matchLine(const Derived & derived, StringView source,
+                   std::size_t & index);
+
+    /// @return Position of the beginning of the line that contains
+    /// source[index] if all symbols between them are whitespaces;
+    /// std::string::npos otherwise. Respects line boundary.
+    std::size_t lineBeginningBefore(StringView source,
+                                    std::size_t index) const {
+        const std::size_t boundary = std::min(lineBoundary_, index);
+        const std::size_t pos =
+            Str::Backward::findEolOrNonWs(source, boundary, index);
+        if (pos == Str::npos())
+            return boundary;
+        return source[pos] == '\n' ? pos + 1 : std::string::npos;
+    }
 
+    /// @brief Stores positions of the match for getLineBeginning() and
+    /// getPatternBeginning().
+    void setMatchPositions(std::size_t lineBeginning,
+                           std::size_t patternBeginning) {
+        lineBeginning_ = lineBeginning;
+        patternBeginning_ = patternBeginning;
+    }
+
+private:
     std::size_t lineBeginning_, patternBeginning_;
+    std::size_t lineBoundary_ = 0;
 };
 
+template <class Derived>
+bool SearchLine::matchLine(const Derived & derived, StringView source,
+                           std::size_t & index)
+{
+    while (derived.findStr(source, index), index != std::string::npos) {
+        const std::size_t lineBeginning = lineBeginningBefore(source, index);
+        if (lineBeginning == std::string::npos) {
+            // Not at the beginning of the line -> continue search.
+            index = source.find('\n', index);
+            if (index == std::string::npos)
+                break;
+            ++index;
+            continue;
+        }
+        setMatchPositions(lineBeginning, index);
+        index += derived.size();
+        return true;
+    }
+    return false;
+}
+
 
-class SearchStringLine : public SearchLine
+class SearchStringLine final : public SearchLine
 {
 public:
     explicit SearchStringLine(std::string str) : str_(std::move(str)) {}
 
+    bool match(StringView source, std::size_t & index) override {
+        return matchLine(*this, source, index);
+    }
+
 private:
+    friend class SearchLine;
+
     /// @brief Searches for str_ in source.
-    void findStr(const std::string & source, std::size_t & index) override;
+    void findStr(StringView source, std::size_t & index) const;
 
-    std::size_t size() const override { return str_.size(); }
+    std::size_t size() const { return str_.size(); }
 
     const std::string str_;
 };
 
 
-class SearchCiStringLine : public SearchLine
+/// @brief Case-insensitive SearchStringLine. IncludeExpander searches with
+/// SearchKeywordLine instead; this pattern is kept for library users.
+class SearchCiStringLine final : public SearchLine
 {
 public:
     /// WARNING: lowerStr must be in lowercase!
     explicit SearchCiStringLine(const std::string & lowerStr);
 
+    bool match(StringView source, std::size_t & index) override {
+        return matchLine(*this, source, index);
+    }
+
 private:
-    /// @brief Performs case-insensitive search of lowerStr in source.
-    void findStr(const std::string & source, std::size_t & index) override;
+    friend class SearchLine;
 
-    std::size_t size() const override {
-        return lowerStrWithoutFirstSymbol_.size() + 1;
-    }
+    /// @brief Performs case-insensitive search of lowerStr_ in source.
+    void findStr(StringView source, std::size_t & index) const;
+
+    std::size_t size() const { return lowerStr_.size(); }
 
-    /// Stores 2 symbols: both lower- and uppercase first symbol versions.
-    /// If first symbol of lowerStr wasn't letter, stores only one symbol.
-    /// NOTE: non-const only because of verbose initialization in constructor.
-    /// May not be changed after constructor.
-    std::string firstSymbol_;
-    const std::string lowerStrWithoutFirstSymbol_;
+    const std::string lowerStr_;
 };
 
 
+/// @brief Finds line that starts with one of the registered keywords.
+/// Semantics are the same as of SearchStringLine and SearchCiStringLine, but
+/// only the first non-whitespace symbol of each line is examined. Thus the
+/// search is a single forward pass over source, and its cost does not depend
+/// on the number of keywords.
+/// WARNING: keywords are not copied, so they must outlive SearchKeywordLine.
+class SearchKeywordLine final : public SearchLine
+{
+public:
+    enum CaseSensitivity { caseSensitive, caseInsensitive };
+
+    SearchKeywordLine() = default;
+    /// @brief Registers keyword. See addKeyword().
+    explicit SearchKeywordLine(StringView keyword,
+                               CaseSensitivity sensitivity = caseSensitive) {
+        addKeyword(keyword, sensitivity);
+    }
+    /// Temporary string would be destroyed before the pattern is used.
+    template <class Str, class = typename std::enable_if<
+                  IsOwningString<Str>::value>::type>
+    explicit SearchKeywordLine(Str &&,
+                               CaseSensitivity = caseSensitive) = delete;
+
+    /// @brief Registers keyword. If several keywords start the same line, the
+    /// one that was registered first is matched.
+    /// WARNING: case-insensitive keyword must be in lowercase!
+    /// @return Id of keyword, which is returned by getKeywordId().
+    /// @throw std::runtime_error If keyword is empty.
+    std::size_t addKeyword(StringView keyword, CaseSensitivity sensitivity);
+    template <class Str, class = typename std::enable_if<
+                  IsOwningString<Str>::value>::type>
+    std::size_t addKeyword(Str &&, CaseSensitivity) = delete;
+
+    bool match(StringView source, std::size_t & index) override;
+
+    /// @return Id of matched keyword. Undefined number if match has never
+    /// occurred.
+    std::size_t getKeywordId() const { return keywordId_; }
+
+private:
+    struct Keyword {
+        StringView str;
+        CaseSensitivity sensitivity;
+    };
+
+    /// @return Id of the first keyword that matches source starting from
+    /// index; std::string::npos if there is no such keyword.
+    std::size_t findKeyword(StringView source, std::size_t index) const;
+
+    std::vector<Keyword> keywords_;
+    /// Ids of keywords that can start with each of 256 symbols.
+    std::array<std::vector<std::size_t>, 256> candidates_;
+    std::size_t keywordId_;
+};
+
 
 /// @brief Matches source string with the sequence of patterns.
 class PatternMatcher
@@ -278,13 +514,117 @@ public:
     /// symbol for most patterns; and std::string::npos in case of
     /// Search* patterns).
     /// @return true if source matches patternSequence_.
-    bool match(const std::string & source, std::size_t & index);
+    bool match(StringView source, std::size_t & index);
 
 private:
     const PatternSequence & patternSequence_;
     std::size_t patternId_ = 0;
 };
 
+
+/// @brief Describes how StaticPatternMatcher matches an element of its
+/// sequence. Element is a single pattern by default.
+template <class Element>
+struct StaticPatternStep {
+    static constexpr std::size_t count = 1;
+
+    /// @brief Matches element's patterns starting from pattern first.
+    /// Increments patternId for each matched pattern.
+    static bool match(Element & element, std::size_t /*first*/,
+                      StringView source, std::size_t & index,
+                      std::size_t & patternId) {
+        // Qualified call is not dispatched virtually.
+        if (! element.Element::match(source, index))
+            return false;
+        ++patternId;
+        return true;
+    }
+};
+
+/// @brief Array element is a subsequence of its N patterns.
+template <class Element, std::size_t N>
+struct StaticPatternStep<std::array<Element, N>> {
+    static constexpr std::size_t count = N;
+
+    static bool match(std::array<Element, N> & element, std::size_t first,
+                      StringView source, std::size_t & index,
+                      std::size_t & patternId) {
+        for (std::size_t i = first; i < N; ++i) {
+            if (! StaticPatternStep<Element>::match(element[i], 0, source,
+                                                    index, patternId)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/// @brief Has the same interface and semantics as PatternMatcher, but the
+/// sequence of patterns is fixed at compile time: Elements are concrete
+/// Pattern types or std::arrays of them. Each pattern's match() is called
+/// directly (without virtual dispatch), so the compiler can inline the whole
+/// sequence into a single forward scan.
+/// currentPatternIndex() counts each pattern of an array element separately.
+/// NOTE: stores references to patterns, which must outlive the matcher.
+template <class... Elements>
+class StaticPatternMatcher
+{
+public:
+    explicit StaticPatternMatcher(Elements &... elements)
+        : elements_(elements...)
+    {}
+
+    /// @return Total number of patterns in the sequence.
+    static constexpr std::size_t size() { return countFrom<0>(); }
+
+    std::size_t currentPatternIndex() const { return patternId_; }
+
+    /// @brief Resets current pattern id to initial state. Thus, enables reuse.
+    void reset() { patternId_ = 0; }
+
+    /// @brief See PatternMatcher::match().
+    bool match(StringView source, std::size_t & index) {
+        return matchFrom<0>(source, index, 0);
+    }
+
+private:
+    template <std::size_t i>
+    using Element = typename std::tuple_element<
+                    i, std::tuple<Elements...>>::type;
+
+    template <std::size_t i>
+    static constexpr
+    typename std::enable_if<(i < sizeof...(Elements)), std::size_t>::type
+    countFrom() {
+        return StaticPatternStep<Element<i>>::count + countFrom<i + 1>();
+    }
+
+    template <std::size_t i>
+    static constexpr
+    typename std::enable_if<i == sizeof...(Elements), std::size_t>::type
+    countFrom() { return 0; }
+
+    /// @param offset Index of the first pattern of element i in the sequence.
+    template <std::size_t i>
+    typename std::enable_if<(i < sizeof...(Elements)), bool>::type
+    matchFrom(StringView source, std::size_t & index, std::size_t offset) {
+        typedef StaticPatternStep<Element<i>> Step;
+        if (patternId_ < offset + Step::count &&
+                ! Step::match(std::get<i>(elements_), patternId_ - offset,
+                              source, index, patternId_)) {
+            return false;
+        }
+        return matchFrom<i + 1>(source, index, offset + Step::count);
+    }
+
+    template <std::size_t i>
+    typename std::enable_if<i == sizeof...(Elements), bool>::type
+    matchFrom(StringView, std::size_t &, std::size_t) { return true; }
+
+    std::tuple<Elements &...> elements_;
+    std::size_t patternId_ = 0;
+};
+
 } // END namespace PatternUtilities
 
 # endif // PATTERN_UTILITIES_HPP
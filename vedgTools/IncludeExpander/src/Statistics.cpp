@@ -0,0 +1,104 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# include "Statistics.hpp"
+
+# include <cstddef>
+# include <algorithm>
+# include <string>
+# include <ostream>
+# include <iomanip>
+
+
+Statistics & Statistics::operator+=(const Statistics & other)
+{
+    filesExpanded += other.filesExpanded;
+    filesRead += other.filesRead;
+    bytesRead += other.bytesRead;
+    filesWritten += other.filesWritten;
+    bytesWritten += other.bytesWritten;
+
+    moduleCacheHits += other.moduleCacheHits;
+    moduleCacheMisses += other.moduleCacheMisses;
+    diskCacheHits += other.diskCacheHits;
+    diskCacheMisses += other.diskCacheMisses;
+
+    includesExpanded += other.includesExpanded;
+    indentationBytes += other.indentationBytes;
+    maxIncludeDepth = std::max(maxIncludeDepth, other.maxIncludeDepth);
+
+    readSeconds += other.readSeconds;
+    expandSeconds += other.expandSeconds;
+    writeSeconds += other.writeSeconds;
+
+    for (const auto & attempts : other.patternMatchAttempts)
+        patternMatchAttempts[attempts.first] += attempts.second;
+    return *this;
+}
+
+void Statistics::print(std::ostream & os, Format format) const
+{
+    const std::ios_base::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision(6);
+    if (format == json) {
+        os << "{\"filesExpanded\": " << filesExpanded
+           << ", \"filesRead\": " << filesRead
+           << ", \"bytesRead\": " << bytesRead
+           << ", \"filesWritten\": " << filesWritten
+           << ", \"bytesWritten\": " << bytesWritten
+           << ", \"moduleCacheHits\": " << moduleCacheHits
+           << ", \"moduleCacheMisses\": " << moduleCacheMisses
+           << ", \"diskCacheHits\": " << diskCacheHits
+           << ", \"diskCacheMisses\": " << diskCacheMisses
+           << ", \"includesExpanded\": " << includesExpanded
+           << ", \"indentationBytes\": " << indentationBytes
+           << ", \"maxIncludeDepth\": " << maxIncludeDepth
+           << ", \"readSeconds\": " << readSeconds
+           << ", \"expandSeconds\": " << expandSeconds
+           << ", \"writeSeconds\": " << writeSeconds
+           << ", \"patternMatchAttempts\": {";
+        // Pattern type names contain no characters that need escaping.
+        for (auto it = patternMatchAttempts.begin();
+                it != patternMatchAttempts.end(); ++it) {
+            if (it != patternMatchAttempts.begin())
+                os << ", ";
+            os << '"' << it->first << "\": " << it->second;
+        }
+        os << "}}\n";
+    }
+    else {
+        os << "Files expanded: " << filesExpanded << '\n'
+           << "Files read: " << filesRead << " (" << bytesRead << " bytes)\n"
+           << "Files written: " << filesWritten << " (" << bytesWritten
+           << " bytes)\n"
+           << "Module cache: " << moduleCacheHits << " hits, "
+           << moduleCacheMisses << " misses\n"
+           << "Disk cache: " << diskCacheHits << " hits, "
+           << diskCacheMisses << " misses\n"
+           << "Includes expanded: " << includesExpanded << '\n'
+           << "Indentation bytes inserted: " << indentationBytes << '\n'
+           << "Max include depth: " << maxIncludeDepth << '\n'
+           << "Time (s): read " << readSeconds << ", expand "
+           << expandSeconds << ", write " << writeSeconds << '\n'
+           << "Pattern match attempts:\n";
+        for (const auto & attempts : patternMatchAttempts)
+            os << "  " << attempts.first << ": " << attempts.second << '\n';
+    }
+    os.flush();
+    os.flags(flags);
+}
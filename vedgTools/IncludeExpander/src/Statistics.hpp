@@ -0,0 +1,96 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# ifndef INCLUDE_EXPANDER_STATISTICS_HPP
+# define INCLUDE_EXPANDER_STATISTICS_HPP
+
+# include <CommonUtilities/CopyAndMoveSemantics.hpp>
+
+# include <cstddef>
+# include <chrono>
+# include <map>
+# include <string>
+# include <ostream>
+
+
+/// @brief Counters and timings of IncludeExpander's work. Timings are summed
+/// over all threads.
+struct Statistics {
+    std::size_t filesExpanded = 0;
+    std::size_t filesRead = 0;
+    std::size_t bytesRead = 0;
+    std::size_t filesWritten = 0;
+    std::size_t bytesWritten = 0;
+
+    std::size_t moduleCacheHits = 0;
+    std::size_t moduleCacheMisses = 0;
+    std::size_t diskCacheHits = 0;
+    std::size_t diskCacheMisses = 0;
+
+    std::size_t includesExpanded = 0;
+    std::size_t indentationBytes = 0;
+    std::size_t maxIncludeDepth = 0;
+
+    double readSeconds = 0;
+    /// Includes reading of modules and, unless the persistent cache is
+    /// enabled, writing of expanded files, which are written while being
+    /// expanded.
+    double expandSeconds = 0;
+    double writeSeconds = 0;
+
+    /// (Pattern type, number of match() calls)
+    std::map<std::string, std::size_t> patternMatchAttempts;
+
+    Statistics & operator+=(const Statistics & other);
+
+    enum Format { text, json };
+    void print(std::ostream & os, Format format) const;
+};
+
+
+/// @brief Adds the time of its lifetime (or till stop()) to *seconds unless
+/// seconds is nullptr. Does not query the clock if seconds is nullptr.
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(double * seconds) : seconds_(seconds) {
+        if (seconds_ != nullptr)
+            start_ = Clock::now();
+    }
+
+    NEITHER_COPYABLE_NOR_MOVABLE(ScopedTimer)
+    ~ScopedTimer() { stop(); }
+
+    /// @brief Adds the time elapsed since construction. Subsequent calls do
+    /// nothing.
+    void stop() {
+        if (seconds_ != nullptr) {
+            *seconds_ += std::chrono::duration<double>(
+                             Clock::now() - start_).count();
+            seconds_ = nullptr;
+        }
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    double * seconds_;
+    Clock::time_point start_;
+};
+
+# endif // INCLUDE_EXPANDER_STATISTICS_HPP
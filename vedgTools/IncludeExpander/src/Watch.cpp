@@ -0,0 +1,359 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# include "Watch.hpp"
+
+# include "IncludeExpander.hpp"
+
+# include <CommonUtilities/String.hpp>
+# include <CommonUtilities/Streams.hpp>
+
+# include <cstddef>
+# include <utility>
+# include <algorithm>
+# include <vector>
+# include <map>
+# include <set>
+# include <string>
+# include <iostream>
+
+# ifdef __linux__
+#   include <cerrno>
+#   include <climits>
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#   include <sys/inotify.h>
+#   include <poll.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#   define INCLUDE_EXPANDER_HAS_INOTIFY 1
+# else
+#   define INCLUDE_EXPANDER_HAS_INOTIFY 0
+# endif
+
+
+# if INCLUDE_EXPANDER_HAS_INOTIFY
+
+namespace
+{
+typedef IncludeExpander::Job Job;
+
+class Watcher
+{
+public:
+    explicit Watcher(IncludeExpander & expander, const std::vector<Job> & jobs,
+                     const std::string & modulesDir, unsigned threadCount)
+        : expander_(expander), jobs_(jobs), modulesDir_(modulesDir),
+          threadCount_(threadCount), dependencies_(jobs.size()) {}
+
+    ~Watcher();
+
+    /// @brief Starts watching. Prints error message to std::cerr in case of
+    /// failure.
+    /// @return false in case of failure.
+    bool start(const std::string & controlFile);
+
+    /// @brief Expands all jobs, then repeats affected jobs on changes until
+    /// "quit" command is received.
+    void run();
+
+private:
+    enum Command { noCommand, expandCommand, quitCommand };
+
+    /// @return Descriptor of the watch on dir; -1 in case of failure.
+    int addWatch(const std::string & dir);
+
+    /// @brief Reads all pending inotify events; then waits for more events
+    /// until none arrive during a short period. Thus editors that save files
+    /// in several steps cause a single update.
+    void readEvents();
+    /// @brief Records changes reported by events in buffer.
+    void processEvents(const char * buffer, std::size_t size);
+
+    /// @brief Reads commands from control file.
+    /// @return The last complete command.
+    Command readCommands();
+
+    /// @brief Expands jobs that are affected by recorded changes.
+    void update();
+    /// @brief Expands jobs with the specified indices.
+    void expand(const std::vector<std::size_t> & jobIndices);
+
+    IncludeExpander & expander_;
+    const std::vector<Job> & jobs_;
+    const std::string modulesDir_;
+    const unsigned threadCount_;
+    std::vector<IncludeExpander::Dependencies> dependencies_;
+
+    int inotify_ = -1;
+    int control_ = -1;
+    int modulesWatch_ = -1;
+    /// ((watch descriptor, file name), indices of jobs with this input)
+    std::map<std::pair<int, std::string>, std::vector<std::size_t>> inputs_;
+    std::string pendingCommand_;
+
+    std::set<std::string> changedModules_;
+    std::set<std::size_t> changedJobs_;
+    /// True if some events were lost.
+    bool overflow_ = false;
+};
+
+
+Watcher::~Watcher()
+{
+    if (inotify_ != -1)
+        ::close(inotify_);
+    if (control_ != -1)
+        ::close(control_);
+}
+
+bool Watcher::start(const std::string & controlFile)
+{
+    inotify_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_ == -1) {
+        std::cerr << "Initializing inotify failed." << std::endl;
+        return false;
+    }
+    modulesWatch_ = addWatch(modulesDir_.empty() ? "." : modulesDir_);
+    if (modulesWatch_ == -1)
+        return false;
+    for (std::size_t i = 0; i < jobs_.size(); ++i) {
+        const std::string & input = jobs_[i].first;
+        const std::size_t slash = input.rfind('/');
+        const int wd = addWatch(slash == std::string::npos ? "." :
+                                slash == 0 ? "/" : input.substr(0, slash));
+        if (wd == -1)
+            return false;
+        inputs_[std::make_pair(wd, input.substr(slash + 1))].push_back(i);
+    }
+
+    if (! controlFile.empty()) {
+        // Opening for writing too prevents EOF when the last client closes
+        // the FIFO.
+        if ((::mkfifo(controlFile.c_str(), 0666) != 0 && errno != EEXIST) ||
+                (control_ = ::open(controlFile.c_str(),
+                                   O_RDWR | O_NONBLOCK | O_CLOEXEC)) == -1) {
+            std::cerr << "Opening control file " << controlFile << " failed."
+                      << std::endl;
+            return false;
+        }
+        struct stat status;
+        if (::fstat(control_, &status) != 0 || ! S_ISFIFO(status.st_mode)) {
+            std::cerr << "Control file " << controlFile << " is not a FIFO."
+                      << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void Watcher::run()
+{
+    std::vector<std::size_t> all(jobs_.size());
+    for (std::size_t i = 0; i < all.size(); ++i)
+        all[i] = i;
+    expand(all);
+
+    while (true) {
+        pollfd fds[2] = { { inotify_, POLLIN, 0 }, { control_, POLLIN, 0 } };
+        if (::poll(fds, control_ == -1 ? 1 : 2, -1) < 0)
+            continue; // EINTR
+        if (fds[0].revents != 0) {
+            readEvents();
+            update();
+        }
+        if (control_ != -1 && fds[1].revents != 0) {
+            switch (readCommands()) {
+                case noCommand:
+                    break;
+                case expandCommand:
+                    expander_.clearCache();
+                    expand(all);
+                    break;
+                case quitCommand:
+                    return;
+            }
+        }
+    }
+}
+
+int Watcher::addWatch(const std::string & dir)
+{
+    const int wd = ::inotify_add_watch(
+                       inotify_, dir.c_str(),
+                       IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                       IN_DELETE);
+    if (wd == -1)
+        std::cerr << "Watching directory " << dir << " failed." << std::endl;
+    return wd;
+}
+
+void Watcher::readEvents()
+{
+    const int quietPeriodMs = 10;
+    union {
+        inotify_event event;
+        char bytes[64 * (sizeof(inotify_event) + NAME_MAX + 1)];
+    } buffer;
+    do {
+        ssize_t size;
+        while ((size = ::read(inotify_, buffer.bytes, sizeof(buffer))) > 0)
+            processEvents(buffer.bytes, static_cast<std::size_t>(size));
+        pollfd fd = { inotify_, POLLIN, 0 };
+        if (::poll(&fd, 1, quietPeriodMs) <= 0)
+            break;
+    }
+    while (true);
+}
+
+void Watcher::processEvents(const char * buffer, std::size_t size)
+{
+    const std::string extension = ".cmake";
+    for (std::size_t offset = 0; offset < size;) {
+        // The kernel pads names, so that all events are aligned.
+        const inotify_event & event =
+            *reinterpret_cast<const inotify_event *>(buffer + offset);
+        offset += sizeof(inotify_event) + event.len;
+        if ((event.mask & IN_Q_OVERFLOW) != 0) {
+            overflow_ = true;
+            continue;
+        }
+        if (event.len == 0)
+            continue;
+        const std::string name = event.name;
+
+        if (event.wd == modulesWatch_ && name.size() > extension.size() &&
+                name.compare(name.size() - extension.size(), extension.size(),
+                             extension) == 0) {
+            changedModules_.insert(
+                name.substr(0, name.size() - extension.size()));
+        }
+        const auto it = inputs_.find(std::make_pair(event.wd, name));
+        if (it != inputs_.end())
+            changedJobs_.insert(it->second.begin(), it->second.end());
+    }
+}
+
+Watcher::Command Watcher::readCommands()
+{
+    Command result = noCommand;
+    char buffer[256];
+    ssize_t size;
+    while ((size = ::read(control_, buffer, sizeof(buffer))) > 0)
+        pendingCommand_.append(buffer, static_cast<std::size_t>(size));
+
+    std::size_t lineEnd;
+    while ((lineEnd = pendingCommand_.find('\n')) != std::string::npos) {
+        std::string command = pendingCommand_.substr(0, lineEnd);
+        pendingCommand_.erase(0, lineEnd + 1);
+        CommonUtilities::String::trim(command);
+        if (command == "expand")
+            result = std::max(result, expandCommand);
+        else if (command == "quit")
+            result = quitCommand;
+        else if (! command.empty()) {
+            std::cerr << "Unknown command \"" << command << "\" ignored."
+                      << std::endl;
+        }
+    }
+    return result;
+}
+
+void Watcher::update()
+{
+    std::vector<std::size_t> jobIndices;
+    if (overflow_) {
+        expander_.clearCache();
+        for (std::size_t i = 0; i < jobs_.size(); ++i)
+            jobIndices.push_back(i);
+    }
+    else {
+        for (const std::string & moduleName : changedModules_)
+            expander_.invalidateModule(moduleName);
+        for (std::size_t i = 0; i < jobs_.size(); ++i) {
+            const IncludeExpander::Dependencies & dependencies =
+                dependencies_[i];
+            bool affected = changedJobs_.count(i) != 0 ||
+                            (! changedModules_.empty() &&
+                             dependencies.empty());
+            for (auto it = changedModules_.begin();
+                    ! affected && it != changedModules_.end(); ++it) {
+                affected = std::binary_search(dependencies.begin(),
+                                              dependencies.end(), *it);
+            }
+            if (affected)
+                jobIndices.push_back(i);
+        }
+    }
+    overflow_ = false;
+    changedModules_.clear();
+    changedJobs_.clear();
+    if (! jobIndices.empty())
+        expand(jobIndices);
+}
+
+void Watcher::expand(const std::vector<std::size_t> & jobIndices)
+{
+    std::vector<Job> jobs;
+    jobs.reserve(jobIndices.size());
+    for (std::size_t i : jobIndices)
+        jobs.push_back(jobs_[i]);
+    std::vector<IncludeExpander::Dependencies> dependencies;
+    const std::size_t unchangedBefore = expander_.unchangedOutputCount();
+    expander_(jobs, modulesDir_, threadCount_, &dependencies);
+    for (std::size_t i = 0; i < jobIndices.size(); ++i)
+        dependencies_[jobIndices[i]] = std::move(dependencies[i]);
+    // Standard output can be an expanded file.
+    std::cerr << "Expanded " << jobIndices.size() << " of " << jobs_.size()
+              << " files";
+    const std::size_t unchanged =
+        expander_.unchangedOutputCount() - unchangedBefore;
+    if (unchanged != 0)
+        std::cerr << ", " << unchanged << " of them were unchanged";
+    std::cerr << '.' << std::endl;
+}
+
+} // END unnamed namespace
+
+# endif // INCLUDE_EXPANDER_HAS_INOTIFY
+
+
+int watch(IncludeExpander & expander,
+          const std::vector<IncludeExpander::Job> & jobs,
+          const std::string & modulesDir, unsigned threadCount,
+          const std::string & controlFile)
+{
+# if INCLUDE_EXPANDER_HAS_INOTIFY
+    // Watched files are edited while the process runs.
+    expander.setReadMode(CommonUtilities::MappedFile::readIntoBuffer);
+    Watcher watcher(expander, jobs, modulesDir, threadCount);
+    if (! watcher.start(controlFile))
+        return 3;
+    watcher.run();
+    return 0;
+# else
+    static_cast<void>(expander);
+    static_cast<void>(jobs);
+    static_cast<void>(modulesDir);
+    static_cast<void>(threadCount);
+    static_cast<void>(controlFile);
+    std::cerr << "Error: watching is not supported on this platform."
+              << std::endl;
+    return 1;
+# endif
+}
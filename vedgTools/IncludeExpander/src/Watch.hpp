@@ -0,0 +1,45 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+# ifndef INCLUDE_EXPANDER_WATCH_HPP
+# define INCLUDE_EXPANDER_WATCH_HPP
+
+# include "IncludeExpander.hpp"
+
+# include <vector>
+# include <string>
+
+
+/// @brief Expands jobs, then keeps watching their inputs and modulesDir.
+/// When a module changes, only this module and the modules that include it
+/// are expanded again, and only outputs that depend on it are rewritten.
+/// Outputs whose inputs change are rewritten too. Jobs without dependencies
+/// (including failed ones) are repeated whenever any module changes.
+/// NOTE: modules in subdirectories of modulesDir are not watched.
+/// @param controlFile If not empty, FIFO (is created if missing) that accepts
+/// newline-terminated commands: "expand" forgets all expanded modules and
+/// repeats all jobs; "quit" stops watching.
+/// @return Exit code suitable to return from main(): 0 after "quit"
+/// command, 1 if watching is not supported on this platform, 3 if watching
+/// fails.
+int watch(IncludeExpander & expander,
+          const std::vector<IncludeExpander::Job> & jobs,
+          const std::string & modulesDir, unsigned threadCount,
+          const std::string & controlFile);
+
+# endif // INCLUDE_EXPANDER_WATCH_HPP
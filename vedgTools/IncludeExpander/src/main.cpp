@@ -1,6 +1,6 @@
 /*
  This file is part of vedgTools/IncludeExpander.
- Copyright (C) 2014 Igor Kushnir <igorkuo AT Google mail>
+ Copyright (C) 2014, 2015 Igor Kushnir <igorkuo AT Google mail>
 
  vedgTools/IncludeExpander is free software: you can redistribute it and/or
  modify it under the terms of the GNU General Public License as published by
@@ -17,11 +17,92 @@
 */
 
 # include "IncludeExpander.hpp"
+# include "ModuleProvider.hpp"
+# include "ModuleBundle.hpp"
+# include "Watch.hpp"
+# include "Statistics.hpp"
+
+# include <CommonUtilities/String.hpp>
 
 # include <tclap/CmdLine.h>
 
+# include <cstddef>
+# include <utility>
+# include <memory>
+# include <vector>
 # include <string>
+# include <istream>
 # include <iostream>
+# include <fstream>
+
+
+namespace
+{
+/// @brief Appends to inputFiles names listed in listFile (one per line,
+/// empty lines are ignored). If listFile is "-", reads names from stdin.
+/// @return false in case of reading error.
+bool readInputList(const std::string & listFile,
+                   std::vector<std::string> & inputFiles)
+{
+    std::ifstream file;
+    if (listFile != "-")
+        file.open(listFile);
+    std::istream & is = listFile == "-" ? std::cin : file;
+    std::string line;
+    while (std::getline(is, line)) {
+        CommonUtilities::String::trim(line);
+        if (! line.empty())
+            inputFiles.push_back(std::move(line));
+    }
+    if (is.bad() || (! is.eof() && is.fail())) {
+        std::cerr << "Reading file " << listFile << " failed." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/// @return pattern, in which "%d", "%n" and "%e" are replaced with directory
+/// (including trailing '/'), name without extension and extension (including
+/// leading '.') of inputFile respectively; "%%" is replaced with '%'.
+std::string makeOutputName(const std::string & pattern,
+                           const std::string & inputFile)
+{
+    const std::size_t slash = inputFile.rfind('/');
+    const std::size_t nameBeginning =
+        slash == std::string::npos ? 0 : slash + 1;
+    std::size_t dot = inputFile.rfind('.');
+    // Leading dot of hidden file is not an extension separator.
+    if (dot == std::string::npos || dot <= nameBeginning)
+        dot = inputFile.size();
+
+    std::string result;
+    for (std::size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] != '%' || i + 1 == pattern.size()) {
+            result += pattern[i];
+            continue;
+        }
+        switch (pattern[++i]) {
+            case 'd':
+                result.append(inputFile, 0, nameBeginning);
+                break;
+            case 'n':
+                result.append(inputFile, nameBeginning, dot - nameBeginning);
+                break;
+            case 'e':
+                result.append(inputFile, dot, std::string::npos);
+                break;
+            case '%':
+                result += '%';
+                break;
+            default:
+                result += '%';
+                result += pattern[i];
+        }
+    }
+    return result;
+}
+
+} // END unnamed namespace
 
 
 int main(int argc, char * argv[])
@@ -31,7 +112,7 @@ int main(int argc, char * argv[])
             EXECUTABLE_NAME
             " - expands " + IncludeExpander::startCommand() + '(' +
             IncludeExpander::libraryPrefix() + "...) command in CMake file.",
-            ' ', "1");
+            ' ', IncludeExpander::version().str());
 
         const std::string stringTypeDesc = "string";
 
@@ -40,7 +121,7 @@ int main(int argc, char * argv[])
             stringTypeDesc, cmd);
 
         TCLAP::ValueArg<std::string> outputArg(
-            "o", "output", "Expanded CMake file", false,
+            "o", "output", "Expanded CMake file; \"-\" means stdout", false,
             "CMakeLists_expanded.txt", stringTypeDesc, cmd);
 
         TCLAP::ValueArg<std::string> modulesDirArg(
@@ -49,10 +130,170 @@ int main(int argc, char * argv[])
             IncludeExpander::libraryCollection() + " directory",
             false, "../..", stringTypeDesc, cmd);
 
+        TCLAP::ValueArg<std::string> listArg(
+            "l", "list",
+            "File that lists CMake files to expand in batch mode, one per "
+            "line; \"-\" means stdin", false, "", stringTypeDesc, cmd);
+
+        TCLAP::ValueArg<std::string> outputPatternArg(
+            "p", "output-pattern",
+            "Expanded CMake file name in batch mode. %d, %n and %e are "
+            "replaced with directory, name without extension and extension of "
+            "input file, %% - with %", false, "%d%n_expanded%e",
+            stringTypeDesc, cmd);
+
+        TCLAP::ValueArg<unsigned> jobsArg(
+            "j", "jobs",
+            "Number of threads that expand CMake files in batch mode and "
+            "modules with --pre-expand; 0 means the number of hardware "
+            "threads", false, 1, "unsigned",
+            cmd);
+
+        TCLAP::SwitchArg preExpandArg(
+            "", "pre-expand",
+            "Expand all modules in advance (in --jobs threads)", cmd);
+
+        TCLAP::ValueArg<std::string> cacheDirArg(
+            "", "cache-dir",
+            "Directory that persistently caches expanded modules and CMake "
+            "files between runs; is created if missing. Expanded files are "
+            "then built in memory rather than streamed", false, "",
+            stringTypeDesc, cmd);
+
+        TCLAP::ValueArg<std::string> bundleArg(
+            "", "bundle",
+            "Read modules from the specified bundle file (see --write-bundle) "
+            "instead of --modules-dir", false, "", stringTypeDesc, cmd);
+
+        TCLAP::ValueArg<std::string> writeBundleArg(
+            "", "write-bundle",
+            "Pack all modules into the specified bundle file and exit; with "
+            "--pre-expand, store expanded modules too", false, "",
+            stringTypeDesc, cmd);
+
+        TCLAP::SwitchArg skipUnchangedArg(
+            "u", "skip-unchanged",
+            "Leave expanded files that are up to date untouched (preserve "
+            "their modification time) and report their number to stderr", cmd);
+
+        TCLAP::SwitchArg depfileArg(
+            "d", "depfile",
+            "Write Make/Ninja depfile <expanded file>.d that lists the input "
+            "and all included modules", cmd);
+
+        TCLAP::SwitchArg watchArg(
+            "w", "watch",
+            "Keep running and re-expand CMake files whenever they or modules "
+            "they include change", cmd);
+
+        TCLAP::ValueArg<std::string> controlArg(
+            "", "control",
+            "FIFO that accepts commands in --watch mode: \"expand\" expands "
+            "everything again, \"quit\" exits", false, "", stringTypeDesc,
+            cmd);
+
+        TCLAP::ValueArg<std::string> statsArg(
+            "", "stats",
+            "Print statistics of the run to stderr in the specified format: "
+            "text or json", false, "", "text|json", cmd);
+
+        TCLAP::UnlabeledMultiArg<std::string> inputsArg(
+            "inputs", "CMake files to expand in batch mode", false,
+            stringTypeDesc, cmd);
+
         cmd.parse(argc, argv);
 
-        return IncludeExpander()(inputArg.getValue(), outputArg.getValue(),
-                                 modulesDirArg.getValue());
+        Statistics::Format statsFormat = Statistics::text;
+        if (statsArg.isSet()) {
+            if (statsArg.getValue() == "json")
+                statsFormat = Statistics::json;
+            else if (statsArg.getValue() != "text") {
+                std::cerr << "Error: unknown statistics format \""
+                          << statsArg.getValue() << "\"." << std::endl;
+                return 1;
+            }
+        }
+
+        std::unique_ptr<ModuleBundle> bundle;
+        if (bundleArg.isSet()) {
+            if (watchArg.getValue()) {
+                std::cerr << "Error: --bundle can not be combined with "
+                          "--watch." << std::endl;
+                return 1;
+            }
+            bundle.reset(new ModuleBundle(bundleArg.getValue()));
+            if (! bundle->isFine()) {
+                std::cerr << "Reading bundle " << bundleArg.getValue()
+                          << " failed." << std::endl;
+                return 3;
+            }
+        }
+
+        IncludeExpander expander;
+        expander.setCacheDir(cacheDirArg.getValue());
+        expander.setCollectingStatistics(statsArg.isSet());
+        if (skipUnchangedArg.getValue())
+            expander.setOutputMode(IncludeExpander::skipUnchanged);
+        if (depfileArg.getValue())
+            expander.setDepfileExtension(".d");
+
+        if (writeBundleArg.isSet()) {
+            const FileModuleProvider files(modulesDirArg.getValue());
+            return expander.writeBundle(
+                       bundle == nullptr ?
+                       static_cast<const ModuleProvider &>(files) : *bundle,
+                       writeBundleArg.getValue(), preExpandArg.getValue(),
+                       jobsArg.getValue());
+        }
+        if (preExpandArg.getValue()) {
+            if (bundle == nullptr) {
+                expander.preExpandModules(modulesDirArg.getValue(),
+                                          jobsArg.getValue());
+            }
+            else
+                expander.preExpandModules(*bundle, jobsArg.getValue());
+        }
+
+        std::vector<IncludeExpander::Job> jobs;
+        std::vector<std::string> inputFiles = inputsArg.getValue();
+        if (inputFiles.empty() && ! listArg.isSet())
+            jobs.emplace_back(inputArg.getValue(), outputArg.getValue());
+        else {
+            if (inputArg.isSet() || outputArg.isSet()) {
+                std::cerr << "Error: --"
+                          << (inputArg.isSet() ? "input" : "output")
+                          << " can not be combined with batch mode."
+                          << std::endl;
+                return 1;
+            }
+            if (listArg.isSet() &&
+                    ! readInputList(listArg.getValue(), inputFiles)) {
+                return 3;
+            }
+
+            jobs.reserve(inputFiles.size());
+            for (std::string & input : inputFiles) {
+                std::string output =
+                    makeOutputName(outputPatternArg.getValue(), input);
+                jobs.emplace_back(std::move(input), std::move(output));
+            }
+        }
+
+        const int result =
+            watchArg.getValue() ?
+            watch(expander, jobs, modulesDirArg.getValue(),
+                  jobsArg.getValue(), controlArg.getValue()) :
+            bundle != nullptr ?
+            expander(jobs, *bundle, jobsArg.getValue()) :
+            expander(jobs, modulesDirArg.getValue(), jobsArg.getValue());
+        if (statsArg.isSet())
+            expander.statistics()->print(std::cerr, statsFormat);
+        if (skipUnchangedArg.getValue() && ! watchArg.getValue()) {
+            std::cerr << expander.unchangedOutputCount() << " of "
+                      << jobs.size() << " expanded files were unchanged."
+                      << std::endl;
+        }
+        return result;
     }
     catch (const TCLAP::ArgException & e) {
         std::cerr << "Error: " << e.error()
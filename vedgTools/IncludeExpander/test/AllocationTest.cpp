@@ -0,0 +1,166 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/// include_expander_allocation_test [corpus-dir]
+/// Checks that expanding a CMake file makes a number of heap allocations
+/// that depends on the number of included modules, but not on the size of
+/// the file.
+
+# include "IncludeExpander.hpp"
+
+# include <CommonUtilities/Streams.hpp>
+# include <CommonUtilities/Testing.hpp>
+
+# include <cstddef>
+# include <cstdlib>
+# include <new>
+# include <algorithm>
+# include <string>
+# include <atomic>
+# include <iostream>
+# include <fstream>
+
+# if defined(__unix__) || defined(__APPLE__)
+#   include <sys/types.h>
+#   include <sys/stat.h>
+#   define ALLOCATION_TEST_POSIX 1
+# else
+#   define ALLOCATION_TEST_POSIX 0
+# endif
+
+
+namespace
+{
+/// Number of operator new calls since the start of the program.
+std::atomic<std::size_t> allocationCount(0);
+
+/// Allocations allowed per included module.
+constexpr std::size_t allocationsPerModule = 8;
+/// Allocations allowed regardless of modules.
+constexpr std::size_t constantAllocations = 64;
+/// Allowed difference between allocation counts for inputs of different
+/// sizes: output buffer grows differently for inputs shorter than it.
+constexpr std::size_t sizeSlack = 2;
+
+/// @brief Writes contents to fileName.
+/// @return false in case of filesystem error.
+bool write(const std::string & fileName, const std::string & contents)
+{
+    std::ofstream file(fileName);
+    file << contents;
+    file.close();
+    if (! CommonUtilities::isStreamFine(file)) {
+        std::cerr << "Writing to file " << fileName << " failed."
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/// @brief Writes CMake file with moduleCount includes of distinct modules
+/// followed by bodyLines ordinary lines to dir + "CMakeLists.txt", expands it
+/// with a fresh IncludeExpander.
+/// @return Number of allocations made by the expansion; 0 in case of error.
+std::size_t countAllocations(const std::string & dir, int moduleCount,
+                             int bodyLines)
+{
+    const std::string cmakeLines =
+        "set(SOURCES main.cpp widget.cpp model.cpp)\n"
+        "    if(CMAKE_COMPILER_IS_GNUCXX)\n"
+        "        add_definitions(-Wall -Wextra) # include is not an include\n"
+        "    endif()\n";
+    std::string input = "cmake_minimum_required(VERSION 2.8)\n";
+    for (int i = 0; i < moduleCount; ++i) {
+        const std::string name = "Module" + std::to_string(i);
+        if (! write(dir + name + ".cmake", cmakeLines))
+            return 0;
+        input += "include(vedgTools/" + name + ")\n";
+    }
+    for (int i = 0; i < bodyLines; i += 4)
+        input += cmakeLines;
+    const std::string inputFile = dir + "CMakeLists.txt";
+    if (! write(inputFile, input))
+        return 0;
+
+    IncludeExpander expander;
+    const std::size_t allocationsBefore = allocationCount;
+    const int exitCode = expander(inputFile, inputFile + ".out", dir);
+    const std::size_t allocations = allocationCount - allocationsBefore;
+    if (exitCode != 0) {
+        std::cerr << "Expansion of " << inputFile << " failed." << std::endl;
+        return 0;
+    }
+    return allocations;
+}
+
+} // END unnamed namespace
+
+
+void * operator new(std::size_t size)
+{
+    ++allocationCount;
+    if (void * const p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept
+{
+    std::free(p);
+}
+
+
+int main(int argc, char * argv[])
+{
+    std::string dir = argc > 1 ? argv[1] :
+                      "include_expander_allocation_test_corpus";
+    if (dir.back() != '/')
+        dir += '/';
+# if ALLOCATION_TEST_POSIX
+    ::mkdir(dir.c_str(), 0777);
+# endif
+
+    bool passed = true;
+    for (int moduleCount : { 0, 10, 100 }) {
+        std::size_t minAllocations = 0, maxAllocations = 0;
+        for (int bodyLines : { 100, 10000, 1000000 }) {
+            const std::size_t allocations =
+                countAllocations(dir, moduleCount, bodyLines);
+            if (allocations == 0)
+                return 5;
+            CommonUtilities::Testing::print(
+                "moduleCount", moduleCount, "bodyLines", bodyLines,
+                "allocations", allocations);
+            if (allocations >
+                    allocationsPerModule * moduleCount + constantAllocations) {
+                std::cerr << "Too many allocations." << std::endl;
+                passed = false;
+            }
+            if (minAllocations == 0)
+                minAllocations = maxAllocations = allocations;
+            minAllocations = std::min(minAllocations, allocations);
+            maxAllocations = std::max(maxAllocations, allocations);
+        }
+        if (maxAllocations - minAllocations > sizeSlack) {
+            std::cerr << "Allocation count depends on input size."
+                      << std::endl;
+            passed = false;
+        }
+    }
+    return passed ? 0 : 1;
+}
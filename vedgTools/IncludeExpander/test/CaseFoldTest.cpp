@@ -0,0 +1,402 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/// include_expander_case_fold_test
+/// Checks CaseFold::equals() and CaseFold::find() of each implementation
+/// (scalar, SSE2, AVX2 if the processor supports it, and the dispatching one)
+/// against std::tolower() in the "C" locale. Texts start at every alignment
+/// that matters for the implementation. Every pair of char values is
+/// compared at the positions where vector blocks start and end.
+
+# include <CommonUtilities/CaseFold.hpp>
+
+# include <cstddef>
+# include <cstdint>
+# include <cctype>
+# include <algorithm>
+# include <vector>
+# include <string>
+# include <iostream>
+
+
+namespace
+{
+using namespace CommonUtilities::CaseFold;
+using CommonUtilities::StringView;
+
+/// Lengths of texts compared by equals(): around multiples of the SSE2
+/// block size.
+constexpr std::size_t equalsLengths[] = { 0, 1, 15, 16, 17, 31, 32, 33 };
+/// Lengths of texts searched by find(): around multiples of SSE2 and AVX2
+/// block sizes and around 64 chars, from which the dispatching find() uses
+/// AVX2.
+constexpr std::size_t findLengths[] = {
+    0, 1, 2, 16, 17, 31, 32, 33, 63, 64, 65, 80
+};
+/// Lengths of searched strings: a block of candidate positions must fit
+/// before last together with the string.
+constexpr std::size_t needleLengths[] = { 1, 2, 3, 16, 17, 33 };
+constexpr std::size_t maxTextLength = 80;
+/// Tested texts start at offsets below this from an address aligned to it.
+constexpr std::size_t maxAlignmentCount = 32;
+
+/// Lowercase chars, among them the non-letters that differ from other
+/// non-letters only in the bit that distinguishes cases of a letter.
+const char needleChars[] = "in@[\\]^_clude\x7f\xc1z`{|}~?\xe1\x01" "a!";
+constexpr std::size_t needleCharCount = sizeof(needleChars) - 1;
+
+/// @return Lowercase text of size chars made of needleChars.
+std::string needleText(std::size_t size)
+{
+    std::string result(size, ' ');
+    for (std::size_t i = 0; i < size; ++i)
+        result[i] = needleChars[i % needleCharCount];
+    return result;
+}
+
+char referenceLower(char c)
+{
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+bool referenceEquals(const char * lower, const char * mixed, std::size_t size)
+{
+    for (std::size_t i = 0; i < size; ++i) {
+        if (referenceLower(mixed[i]) != lower[i])
+            return false;
+    }
+    return true;
+}
+
+const char * referenceFind(const char * first, const char * last,
+                           StringView lower)
+{
+    for (; last - first >= static_cast<std::ptrdiff_t>(lower.size());
+            ++first) {
+        if (referenceEquals(lower.data(), first, lower.size()))
+            return first;
+    }
+    return last;
+}
+
+/// @return c with the case of a letter swapped if swap is true.
+char swapCase(char c, bool swap)
+{
+    if (! swap || ! std::isalpha(static_cast<unsigned char>(c)))
+        return c;
+    return static_cast<char>(c ^ 0x20);
+}
+
+typedef bool (* Equals)(const char * lower, const char * mixed,
+                        std::size_t size);
+typedef const char * (* Find)(const char * first, const char * last,
+                              StringView lower);
+
+struct Implementation {
+    std::string name;
+    /// nullptr if the implementation has no equals().
+    Equals equals;
+    /// Requires a non-empty lower that is not longer than the text unless
+    /// the implementation is the dispatching one.
+    Find find;
+    /// Number of alignments at which the implementation can behave
+    /// differently.
+    std::size_t alignmentCount;
+};
+
+std::vector<Implementation> implementations()
+{
+    using namespace Private;
+    std::vector<Implementation> result {
+        { "scalar", &equalsScalar, &findScalar, 1 }
+    };
+# if COMMON_UTILITIES_CHAR_SCAN_SSE2
+    result.push_back({ "SSE2", &equalsSse2, &findSse2, 16 });
+# endif
+# if COMMON_UTILITIES_CHAR_SCAN_AVX2
+    if (CommonUtilities::CharScan::Private::hasAvx2())
+        result.push_back({ "AVX2", nullptr, &findAvx2, 32 });
+# endif
+    result.push_back({ "dispatching", &equals, &find, maxAlignmentCount });
+    return result;
+}
+
+/// Aligned storage for a tested text and the chars around it, among which
+/// an occurrence that crosses the end of the text fits.
+class Buffer
+{
+public:
+    Buffer() : storage_(maxAlignmentCount * 2 + maxTextLength * 2) {
+        const std::uintptr_t address =
+            reinterpret_cast<std::uintptr_t>(storage_.data());
+        aligned_ = storage_.data() +
+                   (maxAlignmentCount - address % maxAlignmentCount) %
+                   maxAlignmentCount;
+    }
+
+    char * at(std::size_t offset) { return aligned_ + offset; }
+
+    /// @brief Fills the whole storage with copies of str, so that reading
+    /// outside of a tested text can change the result.
+    void fill(StringView str) {
+        for (std::size_t i = 0; i < storage_.size(); ++i)
+            storage_[i] = swapCase(str[i % str.size()], i % 3 == 0);
+    }
+
+private:
+    std::vector<char> storage_;
+    char * aligned_;
+};
+
+class Tester
+{
+public:
+    /// @return Number of failed checks.
+    std::size_t test() {
+        std::size_t failures = 0;
+        for (const Implementation & impl : implementations()) {
+            if (impl.equals) {
+                failures += testEqualsAlignments(impl);
+                failures += testEqualsChars(impl);
+            }
+            failures += testFindAlignments(impl);
+            failures += testFindChars(impl);
+        }
+        failures += testFindEdgeCases();
+        return failures;
+    }
+
+private:
+    /// @brief Compares lowercase texts with their mixed-case copies at every
+    /// pair of alignments, then with each char changed to a different one.
+    std::size_t testEqualsAlignments(const Implementation & impl) {
+        std::size_t failures = 0;
+        for (std::size_t lowerOffset = 0; lowerOffset < impl.alignmentCount;
+                ++lowerOffset) {
+            for (std::size_t mixedOffset = 0;
+                    mixedOffset < impl.alignmentCount; ++mixedOffset) {
+                char * const lower = lower_.at(lowerOffset);
+                char * const mixed = text_.at(mixedOffset);
+                for (std::size_t size : equalsLengths) {
+                    for (std::size_t i = 0; i < size; ++i) {
+                        lower[i] = needleChars[i % needleCharCount];
+                        mixed[i] = swapCase(lower[i], i % 2 == 0);
+                    }
+                    failures += checkEquals(impl, lower, mixed, size);
+                    for (std::size_t i = 0; i < size; ++i) {
+                        const char c = mixed[i];
+                        mixed[i] = static_cast<char>(c ^ 0x20);
+                        failures += checkEquals(impl, lower, mixed, size);
+                        mixed[i] = static_cast<char>(c + 1);
+                        failures += checkEquals(impl, lower, mixed, size);
+                        mixed[i] = c;
+                    }
+                }
+            }
+        }
+        return failures;
+    }
+
+    /// @brief Compares every pair of char values at the first and last
+    /// positions of vector blocks and of the scalar tail.
+    std::size_t testEqualsChars(const Implementation & impl) {
+        std::size_t failures = 0;
+        char * const lower = lower_.at(0);
+        char * const mixed = text_.at(1);
+        for (std::size_t size : equalsLengths) {
+            std::fill(lower, lower + size, 'x');
+            std::fill(mixed, mixed + size, 'X');
+            for (std::size_t i : { 0u, 15u, 16u, 31u, 32u }) {
+                if (i >= size)
+                    continue;
+                for (int l = 0; l < 256; ++l) {
+                    lower[i] = static_cast<char>(l);
+                    for (int m = 0; m < 256; ++m) {
+                        mixed[i] = static_cast<char>(m);
+                        failures += checkEquals(impl, lower, mixed, size);
+                    }
+                }
+                lower[i] = 'x';
+                mixed[i] = 'X';
+            }
+        }
+        return failures;
+    }
+
+    /// @brief Searches a mixed-case copy of lower at every position of texts
+    /// that start at every alignment, then in texts that do not contain it.
+    std::size_t testFindAlignments(const Implementation & impl) {
+        std::size_t failures = 0;
+        for (std::size_t offset = 0; offset < impl.alignmentCount; ++offset) {
+            char * const first = text_.at(offset);
+            for (std::size_t textLength : findLengths) {
+                char * const last = first + textLength;
+                for (std::size_t size : needleLengths) {
+                    if (size > textLength)
+                        continue;
+                    const std::string needle = needleText(size + 1);
+                    const StringView lower = StringView(needle).substr(1);
+                    text_.fill(lower);
+                    std::fill(first, last, '.');
+                    failures += checkFind(impl, first, last, lower);
+                    for (char * p = first; p + size <= last; ++p) {
+                        for (std::size_t i = 0; i < size; ++i)
+                            p[i] = swapCase(lower[i], i % 2 != 0);
+                        failures += checkFind(impl, first, last, lower);
+                        p[size - 1] = static_cast<char>(p[size - 1] ^ 0x20);
+                        failures += checkFind(impl, first, last, lower);
+                        std::fill(p, p + size, '.');
+                    }
+                    // Occurrences that cross last must not be found.
+                    for (std::size_t k = 1; k < size; ++k) {
+                        std::copy(lower.begin(), lower.end(), last - k);
+                        failures += checkFind(impl, first, last, lower);
+                        text_.fill(lower);
+                        std::fill(first, last, '.');
+                    }
+                    if (size < 3)
+                        continue;
+                    // Every size-th position matches the first and last
+                    // chars but not the whole string.
+                    for (std::size_t i = 0; i < textLength; ++i) {
+                        first[i] = i % size == size / 2 ?
+                                   '.' : swapCase(lower[i % size], true);
+                    }
+                    failures += checkFind(impl, first, last, lower);
+                }
+            }
+        }
+        return failures;
+    }
+
+    /// @brief Searches strings with every char value as their first or last
+    /// char in texts that contain them with that char replaced by every char
+    /// value: at the end of the first AVX2 block, which is the end of the
+    /// second SSE2 block, and at the end of the text.
+    std::size_t testFindChars(const Implementation & impl) {
+        std::size_t failures = 0;
+        char * const first = text_.at(0);
+        char * const last = first + maxTextLength;
+        char * const needle = lower_.at(0);
+        for (std::size_t size : { 1u, 2u, 17u }) {
+            const std::string original = needleText(size);
+            std::copy(original.begin(), original.end(), needle);
+            const StringView lower(needle, size);
+            for (std::size_t start : { std::size_t(31),
+                                       maxTextLength - size }) {
+                for (std::size_t i : { std::size_t(0), size - 1 }) {
+                    if (i != 0 && size == 1)
+                        continue;
+                    text_.fill(StringView(".", 1));
+                    std::copy(needle, needle + size, first + start);
+                    for (int l = 0; l < 256; ++l) {
+                        needle[i] = static_cast<char>(l);
+                        for (int m = 0; m < 256; ++m) {
+                            first[start + i] = static_cast<char>(m);
+                            failures += checkFind(impl, first, last, lower);
+                        }
+                    }
+                    needle[i] = original[i];
+                }
+            }
+        }
+        return failures;
+    }
+
+    /// @brief Checks cases that only the dispatching find() handles: empty
+    /// lower and texts shorter than lower.
+    std::size_t testFindEdgeCases() {
+        const Implementation impl = implementations().back();
+        std::size_t failures = 0;
+        char * const first = text_.at(0);
+        const std::string needle = needleText(maxTextLength + 1);
+        text_.fill(needle);
+        for (std::size_t textLength : findLengths) {
+            char * const last = first + textLength;
+            failures += checkFind(impl, first, last, StringView());
+            const StringView lower(needle.data(), textLength + 1);
+            failures += checkFind(impl, first, last, lower);
+        }
+        return failures;
+    }
+
+    /// @return 1 if impl.equals() is wrong, 0 otherwise.
+    static std::size_t checkEquals(const Implementation & impl,
+                                   const char * lower, const char * mixed,
+                                   std::size_t size) {
+        const bool expected = referenceEquals(lower, mixed, size);
+        if (impl.equals(lower, mixed, size) == expected)
+            return 0;
+        std::cerr << impl.name << " equals() is wrong for " << size
+                  << " chars at alignments "
+                  << reinterpret_cast<std::uintptr_t>(lower) %
+                     maxAlignmentCount << " and "
+                  << reinterpret_cast<std::uintptr_t>(mixed) %
+                     maxAlignmentCount << ":";
+        print(StringView(lower, size));
+        std::cerr << " vs";
+        print(StringView(mixed, size));
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    /// @return 1 if impl.find() is wrong, 0 otherwise.
+    static std::size_t checkFind(const Implementation & impl,
+                                 const char * first, const char * last,
+                                 StringView lower) {
+        const char * const expected =
+            lower.empty() ? first : referenceFind(first, last, lower);
+        if (impl.find(first, last, lower) == expected)
+            return 0;
+        std::cerr << impl.name << " find() is wrong in text of "
+                  << last - first << " chars at alignment "
+                  << reinterpret_cast<std::uintptr_t>(first) %
+                     maxAlignmentCount << ":";
+        print(StringView(first, static_cast<std::size_t>(last - first)));
+        std::cerr << " for";
+        print(lower);
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    static void print(StringView text) {
+        for (char c : text)
+            std::cerr << ' ' << static_cast<unsigned>(
+                          static_cast<unsigned char>(c));
+    }
+
+    Buffer lower_;
+    Buffer text_;
+};
+
+} // END unnamed namespace
+
+
+int main()
+{
+# if COMMON_UTILITIES_CHAR_SCAN_AVX2
+    if (! CommonUtilities::CharScan::Private::hasAvx2())
+        std::cout << "AVX2 is not supported, not tested." << std::endl;
+# endif
+    const std::size_t failures = Tester().test();
+    if (failures != 0) {
+        std::cerr << failures << " checks failed." << std::endl;
+        return 1;
+    }
+    return 0;
+}
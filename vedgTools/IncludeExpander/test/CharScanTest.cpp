@@ -0,0 +1,225 @@
+/*
+ This file is part of vedgTools/IncludeExpander.
+ Copyright (C) 2015 Igor Kushnir <igorkuo AT Google mail>
+
+ vedgTools/IncludeExpander is free software: you can redistribute it and/or
+ modify it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ vedgTools/IncludeExpander is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License along with
+ vedgTools/IncludeExpander.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/// include_expander_char_scan_test
+/// Checks each CharScan class against the <cctype> predicate it mirrors for
+/// every char value. Then checks forward and backward scans of each
+/// implementation (scalar, SSE2, AVX2 if the processor supports it, and the
+/// dispatching one) with every char value at every position of texts that
+/// start at every alignment that matters for the implementation.
+
+# include <CommonUtilities/CharScan.hpp>
+
+# include <cstddef>
+# include <cstdint>
+# include <cctype>
+# include <algorithm>
+# include <vector>
+# include <string>
+# include <iostream>
+
+
+namespace
+{
+using namespace CommonUtilities::CharScan;
+
+/// Lengths of tested texts: around multiples of SSE2 and AVX2 block sizes
+/// (the dispatching scans examine the first char separately); 80 chars take
+/// AVX2, SSE2 and scalar steps.
+constexpr std::size_t textLengths[] = { 0, 1, 2, 16, 17, 33, 34, 65, 80 };
+constexpr std::size_t maxTextLength = 80;
+/// Tested texts start at offsets below this from an address aligned to it.
+constexpr std::size_t maxAlignmentCount = 32;
+
+/// @return Membership of c in cls computed by <cctype> functions.
+bool reference(Class cls, char c)
+{
+    const int i = static_cast<unsigned char>(c);
+    switch (cls) {
+        case space:
+            return std::isspace(i);
+        case blank:
+            return std::isblank(i);
+        case spaceExceptEol:
+            return std::isspace(i) && c != '\n';
+        case spaceOrClosingParen:
+            return std::isspace(i) || c == ')';
+    }
+    return false;
+}
+
+typedef const char * (* Find)(const char * first, const char * last);
+
+struct Implementation {
+    std::string name;
+    Find forward;
+    Find backward;
+    /// Number of alignments at which the scans can behave differently.
+    std::size_t alignmentCount;
+};
+
+template <Class cls, bool member>
+std::vector<Implementation> implementations()
+{
+    using namespace Private;
+    std::vector<Implementation> result {
+        { "scalar", &findForwardScalar<cls, member>,
+          &findBackwardScalar<cls, member>, 1 }
+    };
+# if COMMON_UTILITIES_CHAR_SCAN_SSE2
+    result.push_back({ "SSE2", &findForwardSse2<cls, member>,
+                       &findBackwardSse2<cls, member>, 16 });
+# endif
+# if COMMON_UTILITIES_CHAR_SCAN_AVX2
+    if (hasAvx2()) {
+        result.push_back({ "AVX2", &findForwardAvx2<cls, member>,
+                           &findBackwardAvx2<cls, member>, 32 });
+    }
+# endif
+    result.push_back({ "dispatching", &findForward<cls, member>,
+                       &findBackward<cls, member>, maxAlignmentCount });
+    return result;
+}
+
+class Tester
+{
+public:
+    Tester() : storage_(maxAlignmentCount * 2 + maxTextLength) {
+        const std::uintptr_t address =
+            reinterpret_cast<std::uintptr_t>(storage_.data());
+        aligned_ = storage_.data() +
+                   (maxAlignmentCount - address % maxAlignmentCount) %
+                   maxAlignmentCount;
+    }
+
+    /// @return Number of failed checks.
+    template <Class cls>
+    std::size_t testClass(const std::string & className) {
+        std::size_t failures = 0;
+        for (int i = 0; i < 256; ++i) {
+            const char c = static_cast<char>(i);
+            if (contains<cls>(c) != reference(cls, c)) {
+                std::cerr << "contains<" << className << ">(" << i
+                          << ") is wrong." << std::endl;
+                ++failures;
+            }
+        }
+        failures += testScans<cls, true>(className);
+        failures += testScans<cls, false>(className);
+        return failures;
+    }
+
+private:
+    template <Class cls, bool member>
+    std::size_t testScans(const std::string & className) {
+        const char filler = (member != reference(cls, 'a')) ? 'a' : ' ';
+        std::size_t failures = 0;
+        for (const Implementation & impl : implementations<cls, member>()) {
+            for (std::size_t offset = 0; offset < impl.alignmentCount;
+                    ++offset) {
+                char * const first = aligned_ + offset;
+                for (std::size_t length : textLengths) {
+                    failures += testText(impl, className, cls, member,
+                                         filler, first, first + length);
+                }
+            }
+        }
+        return failures;
+    }
+
+    /// @brief Fills [first, last) with filler, whose membership in cls is
+    /// !member, and the rest of storage_ with a char whose membership is
+    /// member, so that reading outside of [first, last) changes the result.
+    /// Checks scans with each char value placed at each position of the text
+    /// and with the text filled with each char value.
+    std::size_t testText(const Implementation & impl,
+                         const std::string & className, Class cls,
+                         bool member, char filler, char * first,
+                         char * last) {
+        std::fill(storage_.begin(), storage_.end(),
+                  filler == 'a' ? ' ' : 'a');
+        std::fill(first, last, filler);
+        std::size_t failures =
+            check(impl, className, member, first, last, last, first);
+        for (int i = 0; i < 256; ++i) {
+            const char c = static_cast<char>(i);
+            const bool found = reference(cls, c) == member;
+            for (char * p = first; p != last; ++p) {
+                *p = c;
+                failures += check(impl, className, member, first, last,
+                                  found ? p : last, found ? p + 1 : first);
+                *p = filler;
+            }
+            std::fill(first, last, c);
+            failures += check(impl, className, member, first, last,
+                              found ? first : last, found ? last : first);
+            std::fill(first, last, filler);
+        }
+        return failures;
+    }
+
+    /// @brief Checks that impl's forward and backward scans of [first, last)
+    /// return expectedForward and expectedBackward.
+    /// @return 1 if the check failed, 0 otherwise.
+    static std::size_t check(const Implementation & impl,
+                             const std::string & className, bool member,
+                             const char * first, const char * last,
+                             const char * expectedForward,
+                             const char * expectedBackward) {
+        if (impl.forward(first, last) == expectedForward &&
+                impl.backward(first, last) == expectedBackward) {
+            return 0;
+        }
+        std::cerr << impl.name << " scan of " << className
+                  << (member ? " members" : " non-members")
+                  << " is wrong in text of " << last - first
+                  << " chars at alignment "
+                  << reinterpret_cast<std::uintptr_t>(first) %
+                     maxAlignmentCount << ":";
+        for (const char * p = first; p != last; ++p)
+            std::cerr << ' ' << static_cast<unsigned>(
+                          static_cast<unsigned char>(*p));
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    std::vector<char> storage_;
+    char * aligned_;
+};
+
+} // END unnamed namespace
+
+
+int main()
+{
+# if COMMON_UTILITIES_CHAR_SCAN_AVX2
+    if (! Private::hasAvx2())
+        std::cout << "AVX2 is not supported, not tested." << std::endl;
+# endif
+    Tester tester;
+    const std::size_t failures =
+        tester.testClass<space>("space") +
+        tester.testClass<blank>("blank") +
+        tester.testClass<spaceExceptEol>("spaceExceptEol") +
+        tester.testClass<spaceOrClosingParen>("spaceOrClosingParen");
+    if (failures != 0) {
+        std::cerr << failures << " checks failed." << std::endl;
+        return 1;
+    }
+    return 0;
+}